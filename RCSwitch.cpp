@@ -68,20 +68,20 @@
  *     |   |_
  *
  * These are combined to form Tri-State bits when sending or receiving codes.
+ *
+ * An optional last field selects the line code (see RCSwitch::LineCode),
+ * e.g. a Manchester coded device with 500 us half bits and a {1, 20} sync,
+ * whose "1" bits are derived from the "0" bits:
+ *   { 500, { 0, 0 }, { 1, 1 }, { 0, 0 }, { 1, 20 }, false, 0, RCSwitch::MANCHESTER }
  */
-#ifdef ESP8266
-static const RCSwitch::Protocol proto[] = {
-#else
-static const RCSwitch::Protocol PROGMEM proto[] = {
-#endif
 //{pulse lenght,{start sync impuls},{"0"-bit},{"1"-bit},{stop sync impuls},inverted Signal}
-  { 350, { 0, 0 }, {  1,  3 }, {  3,  1 }, {  1, 31 }, false },    // protocol 1
-  { 650, { 0, 0 }, {  1,  2 }, {  2,  1 }, {  1, 10 }, false },    // protocol 2
-  { 100, { 0, 0 }, {  4, 11 }, {  9,  6 }, { 30, 71 }, false },    // protocol 3
-  { 380, { 0, 0 }, {  1,  3 }, {  3,  1 }, {  1,  6 }, false },    // protocol 4
-  { 500, { 0, 0 }, {  1,  2 }, {  2,  1 }, {  6, 14 }, false },    // protocol 5
-  { 450, { 0, 0 }, {  1,  2 }, {  2,  1 }, { 23,  1 }, true },      // protocol 6 (HT6P20B)
-  { 250, { 1, 10 }, {  1,  1 }, {  1,  5 }, { 1,  40 }, false },      // protocol 7 (new kaku)
+#define PROTOCOL_1 { 350, { 0, 0 }, {  1,  3 }, {  3,  1 }, {  1, 31 }, false }    // protocol 1
+#define PROTOCOL_2 { 650, { 0, 0 }, {  1,  2 }, {  2,  1 }, {  1, 10 }, false }    // protocol 2
+#define PROTOCOL_3 { 100, { 0, 0 }, {  4, 11 }, {  9,  6 }, { 30, 71 }, false }    // protocol 3
+#define PROTOCOL_4 { 380, { 0, 0 }, {  1,  3 }, {  3,  1 }, {  1,  6 }, false }    // protocol 4
+#define PROTOCOL_5 { 500, { 0, 0 }, {  1,  2 }, {  2,  1 }, {  6, 14 }, false }    // protocol 5
+#define PROTOCOL_6 { 450, { 0, 0 }, {  1,  2 }, {  2,  1 }, { 23,  1 }, true }      // protocol 6 (HT6P20B)
+#define PROTOCOL_7 { 250, { 1, 10 }, {  1,  1 }, {  1,  5 }, { 1,  40 }, false }      // protocol 7 (new kaku)
 
 
 //  { 350, {  1, 31 }, {  1,  3 }, {  3,  1 }, false, 0 },    // protocol 1
@@ -91,26 +91,237 @@ static const RCSwitch::Protocol PROGMEM proto[] = {
 //  { 500, {  6, 14 }, {  1,  2 }, {  2,  1 }, false, 0 },    // protocol 5
 //  { 450, { 23,  1 }, {  1,  2 }, {  2,  1 }, true, 0 },      // protocol 6 (HT6P20B)
 //  { 250, { 1,  40 }, {  1,  1 }, {  1,  5 }, false, 2 },      // protocol 7 (new kaku - bit0 ="01", bit1="01", dim_flag="00")
-};
+
+#ifdef ESP8266
+    #define PROTO_PROGMEM
+#else
+    #define PROTO_PROGMEM PROGMEM
+#endif
+
+/*
+ * Each selected built-in protocol is stored in PROGMEM for the registry and
+ * is also available as a constant expression, so with
+ * RCSWITCH_SPECIALIZED_DECODERS receiveBuiltin() gets a decoder specialized
+ * for it with all factors folded by the compiler.
+ */
+template <int P> struct BuiltinProtocol;
+
+#define BUILTIN_PROTOCOL(P) \
+  template <> struct BuiltinProtocol<P> { \
+    static constexpr RCSwitch::Protocol get() { return PROTOCOL_##P; } \
+  }; \
+  static const RCSwitch::Protocol PROTO_PROGMEM proto##P = PROTOCOL_##P;
+
+#if defined( RCSwitchDisableReceiving )
+    #define BUILTIN_ENTRY(P) { &proto##P, P, true },
+#elif !defined( RCSWITCH_SPECIALIZED_DECODERS )
+    #define BUILTIN_ENTRY(P) { &proto##P, P, true, 0, 0 },
+#else
+    #define BUILTIN_ENTRY(P) { &proto##P, P, true, 0, &RCSwitch::receiveBuiltin<P> },
+#endif
+
+#if RCSWITCH_PROTOCOLS & (1 << 0)
+BUILTIN_PROTOCOL(1)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 1)
+BUILTIN_PROTOCOL(2)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 2)
+BUILTIN_PROTOCOL(3)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 3)
+BUILTIN_PROTOCOL(4)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 4)
+BUILTIN_PROTOCOL(5)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 5)
+BUILTIN_PROTOCOL(6)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 6)
+BUILTIN_PROTOCOL(7)
+#endif
 
 enum {
-   numProto = sizeof(proto) / sizeof(proto[0])
+   // number of built-in protocols, added protocols are numbered after them
+   numProto = 7,
+   // number of built-in protocols selected by RCSWITCH_PROTOCOLS
+   numSelectedProto = ((RCSWITCH_PROTOCOLS >> 0) & 1) + ((RCSWITCH_PROTOCOLS >> 1) & 1) +
+                      ((RCSWITCH_PROTOCOLS >> 2) & 1) + ((RCSWITCH_PROTOCOLS >> 3) & 1) +
+                      ((RCSWITCH_PROTOCOLS >> 4) & 1) + ((RCSWITCH_PROTOCOLS >> 5) & 1) +
+                      ((RCSWITCH_PROTOCOLS >> 6) & 1)
+};
+
+/* The registry starts out with the selected built-in protocols in table order */
+RCSwitch::ProtocolEntry RCSwitch::protocols[RCSWITCH_MAX_PROTOCOLS] = {
+#if RCSWITCH_PROTOCOLS & (1 << 0)
+  BUILTIN_ENTRY(1)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 1)
+  BUILTIN_ENTRY(2)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 2)
+  BUILTIN_ENTRY(3)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 3)
+  BUILTIN_ENTRY(4)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 4)
+  BUILTIN_ENTRY(5)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 5)
+  BUILTIN_ENTRY(6)
+#endif
+#if RCSWITCH_PROTOCOLS & (1 << 6)
+  BUILTIN_ENTRY(7)
+#endif
 };
+volatile uint8_t RCSwitch::nProtocols = numSelectedProto;
+
+#ifdef RaspberryPi
+// the receiver runs in its own thread on the Raspberry Pi
+static pthread_mutex_t protocols_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*
+ * helper functions guarding registry changes against the receiver, the
+ * interrupt state is restored rather than enabled, so they may be called
+ * with interrupts disabled
+ */
+#if defined( RaspberryPi )
+typedef uint8_t InterruptState;
+
+static inline InterruptState lockProtocols() {
+  pthread_mutex_lock(&protocols_mutex);
+  return 0;
+}
+
+static inline void unlockProtocols(InterruptState) {
+  pthread_mutex_unlock(&protocols_mutex);
+}
+#elif defined( __AVR__ )
+typedef uint8_t InterruptState;
+
+static inline InterruptState lockProtocols() {
+  const InterruptState nState = SREG;
+  cli();
+  return nState;
+}
+
+static inline void unlockProtocols(InterruptState nState) {
+  SREG = nState;
+}
+#elif defined( ESP8266 )
+typedef uint32_t InterruptState;
+
+static inline InterruptState lockProtocols() {
+  return xt_rsil(15);
+}
+
+static inline void unlockProtocols(InterruptState nState) {
+  xt_wsr_ps(nState);
+}
+#else
+typedef uint8_t InterruptState;
+
+static inline InterruptState lockProtocols() {
+  noInterrupts();
+  return 0;
+}
+
+static inline void unlockProtocols(InterruptState) {
+  interrupts();
+}
+#endif
 
 #if not defined( RCSwitchDisableReceiving )
 volatile unsigned long RCSwitch::nReceivedValue = 0;
 volatile unsigned int RCSwitch::nReceivedBitlength = 0;
 volatile unsigned int RCSwitch::nReceivedDelay = 0;
 volatile unsigned int RCSwitch::nReceivedProtocol = 0;
+volatile unsigned int RCSwitch::nReceivedConfidence = 0;
 char RCSwitch::nReceiveBinString[RCSWITCH_MAX_CHANGES/2+1];
 char RCSwitch::nLastReceiveBinString[RCSWITCH_MAX_CHANGES/2+1];
 int RCSwitch::nReceiveTolerance = 60;
 //const unsigned int RCSwitch::nSeparationLimit = 4300;
-const unsigned int RCSwitch::nSeparationLimit = 3500;
+unsigned int RCSwitch::nSeparationLimit = 3500;
 // separationLimit: minimum microseconds between received codes, closer codes are ignored.
 // according to discussion on issue #14 it might be more suitable to set the separation
 // limit to the same time as the 'low' part of the sync signal for the current protocol.
-unsigned int RCSwitch::timings[RCSWITCH_MAX_CHANGES];
+unsigned int RCSwitch::nRepeatGapTolerance = 200;
+RCSwitch::Timing RCSwitch::timings[RCSWITCH_MAX_CHANGES];
+unsigned int RCSwitch::nSyncDuration = 0;
+// largest value a captured timing can hold, longer durations saturate
+static const RCSwitch::Timing nTimingMax = (RCSwitch::Timing)~(RCSwitch::Timing)0;
+#if RCSWITCH_LEARNING
+bool RCSwitch::bLearning = false;
+bool RCSwitch::bLearnRegister = false;
+uint8_t RCSwitch::nLearnRepeats = 3;
+uint8_t RCSwitch::nLearnFrames = 0;
+unsigned int RCSwitch::nLearnChangeCount = 0;
+unsigned long RCSwitch::nLearnPulseSum = 0;
+RCSwitch::Protocol RCSwitch::nLearnCandidate;
+volatile bool RCSwitch::bLearnedAvailable = false;
+RCSwitch::Protocol RCSwitch::nLearnedProtocol;
+volatile uint8_t RCSwitch::nLearnedNumber = 0;
+RCSwitch::Protocol RCSwitch::learnedProtocols[RCSWITCH_LEARNED_PROTOCOLS];
+#endif
+bool RCSwitch::bProtocolAutoOrder = false;
+#if RCSWITCH_MAX_HYPOTHESES > 0
+bool RCSwitch::bInterleavedFrames = false;
+RCSwitch::FrameHypothesis RCSwitch::hypotheses[RCSWITCH_MAX_HYPOTHESES];
+#endif
+unsigned long RCSwitch::nReceiveTime = 0;
+volatile bool RCSwitch::bEchoMasking = false;
+unsigned int RCSwitch::nEchoWindow = 200;
+unsigned long RCSwitch::nEchoHoldoff = 500000UL;
+volatile uint8_t RCSwitch::nTransmitLevel = LOW;
+volatile unsigned long RCSwitch::nTransmitEdgeTime = 0;
+volatile unsigned long RCSwitch::nTransmitHash = 0;
+volatile unsigned long RCSwitch::nEchoEdges = 0;
+volatile unsigned int RCSwitch::nEchoFrames = 0;
+bool RCSwitch::bNoiseGating = false;
+unsigned int RCSwitch::nMinPulse = 80;
+uint8_t RCSwitch::nPlausiblePercent = 75;
+volatile bool RCSwitch::bGated = false;
+volatile unsigned long RCSwitch::nGatedEdges = 0;
+volatile unsigned long RCSwitch::nProcessedEdges = 0;
+volatile unsigned long RCSwitch::nGateBlockTime = 0;
+#if RCSWITCH_SOFT_COMBINING
+uint8_t RCSwitch::nSoftFrames = 0;
+uint8_t RCSwitch::nSoftCount = 0;
+uint8_t RCSwitch::nSoftProtocol = 0;
+uint8_t RCSwitch::nSoftBits = 0;
+unsigned long RCSwitch::nSoftTime = 0;
+int16_t RCSwitch::softEvidence[sizeof(unsigned long) * 8];
+// evidence a single bit of a frame adds at most
+static const int nSoftWeight = 15;
+// most bits combined, the width of the received value
+static const unsigned int nSoftMaxBits = sizeof(unsigned long) * 8;
+// frames further apart than this many microseconds belong to different bursts
+static const unsigned long nSoftTimeout = 250000UL;
+#endif
+// number of edges the noise gating judges at once
+static const uint8_t nGateBlock = 32;
+// set by handleInterrupt() when it dropped an echo or noise, the capture is restarted then
+static volatile bool bCaptureReset = false;
+#if RCSWITCH_MAX_HYPOTHESES > 0
+// a hypothesis without frames for this many microseconds is dropped
+static const unsigned long nHypothesisTimeout = 500000UL;
+#endif
+#if RCSWITCH_LEARNING
+// maximum number of distinct durations in a frame the protocol learner accepts
+static const unsigned int nLearnClusters = 6;
+#endif
+// set by receiveProtocol() if the current frame matched a protocol at all
+static bool bFrameDecoded = false;
+#if RCSWITCH_LATENCY_TRACING
+// timestamps of the last published frame, pending until available() reported it
+static RCSwitch::ReceiveTrace receivedTrace;
+static volatile bool bTracePending = false;
+// microseconds from the first edge of the frame being decoded to its end
+static unsigned long nFrameDuration = 0;
+#endif
 #ifdef RaspberryPi
 pthread_cond_t thread_flag_cv;
 pthread_mutex_t thread_flag_mutex;
@@ -120,10 +331,37 @@ bool EnableReceiver=false; // flag signalzet enabled or disabled interupt (exist
 
 RCSwitch::RCSwitch() {
   this->nTransmitterPin = -1;
+  this->pWaveform = 0;
   this->setRepeatTransmit(10);
-  this->setProtocol(1);
+  #if RCSWITCH_TX_QUEUE > 0
+  this->nTxQueueHead = 0;
+  this->nTxQueueCount = 0;
+  this->nDutyPermille = 0;
+  this->nDutyWindow = 3600000UL;
+  this->nAirtimeTokens = 0;
+  this->nAirtimeRefill = 0;
+  this->nAirtimeMillis = 0;
+  this->nAirtimeMicros = 0;
+  #endif
+  #if RCSWITCH_LATENCY_TRACING
+  this->nTransmitProtocol = 0;
+  this->bTraceQueued = false;
+  memset(&this->transmitTrace, 0, sizeof(TransmitTrace));
+  #endif
+  if (!this->setProtocol(1)) {
+    if (RCSwitch::nProtocols > 0) {
+      // protocol 1 is not selected by RCSWITCH_PROTOCOLS, use the first one that is
+      this->setProtocol(RCSwitch::protocols[0].number);
+    } else {
+      // no built-in protocol at all, keep the timings of protocol 1 until
+      // setProtocol() is called with an added one
+      const Protocol fallback = PROTOCOL_1;
+      this->protocol = fallback;
+    }
+  }
   #if not defined( RCSwitchDisableReceiving )
   this->nReceiverInterrupt = -1;
+  this->bReceiveWhileTransmitting = false;
   this->setReceiveTolerance(60);
   RCSwitch::nReceivedValue = 0;
   memset ( RCSwitch::nReceiveBinString, 0, RCSWITCH_MAX_CHANGES/2+1 );
@@ -139,28 +377,236 @@ RCSwitch::RCSwitch() {
   */
 void RCSwitch::setProtocol(Protocol protocol) {
   this->protocol = protocol;
+  #if RCSWITCH_LATENCY_TRACING
+  this->nTransmitProtocol = 0;
+  #endif
 }
 
 /**
-  * Sets the protocol to send, from a list of predefined protocols
+  * Sets the protocol to send, from the protocol registry
+  *
+  * @return false if no protocol with this number is registered, the
+  *         current protocol is kept then
   */
-void RCSwitch::setProtocol(int nProtocol) {
-  if (nProtocol < 1 || nProtocol > numProto) {
-    nProtocol = 1;  // TODO: trigger an error, e.g. "bad protocol" ???
+bool RCSwitch::setProtocol(int nProtocol) {
+  const InterruptState nState = lockProtocols();
+  const int nPosition = findProtocol(nProtocol);
+  if (nPosition >= 0) {
+    loadProtocol(RCSwitch::protocols[nPosition], this->protocol);
+    #if RCSWITCH_LATENCY_TRACING
+    this->nTransmitProtocol = nProtocol;
+    #endif
   }
-#ifdef ESP8266
-  this->protocol = proto[nProtocol-1];
-#else
-  memcpy_P(&this->protocol, &proto[nProtocol-1], sizeof(Protocol));
-#endif
+  unlockProtocols(nState);
+  return nPosition >= 0;
 }
 
 /**
   * Sets the protocol to send with pulse length in microseconds.
   */
-void RCSwitch::setProtocol(int nProtocol, int nPulseLength) {
-  setProtocol(nProtocol);
+bool RCSwitch::setProtocol(int nProtocol, int nPulseLength) {
+  if (!setProtocol(nProtocol)) {
+    return false;
+  }
   this->setPulseLength(nPulseLength);
+  return true;
+}
+
+/**
+ * Adds a protocol to the end of the registry, so it is used for receiving
+ * and can be selected by number with setProtocol().
+ *
+ * The description is not copied and must stay valid while registered.
+ *
+ * @return the number assigned to the protocol, -1 if the registry is full
+ */
+int RCSwitch::addProtocol(const Protocol* protocol) {
+  const InterruptState nState = lockProtocols();
+  const int nProtocol = registerProtocol(protocol);
+  unlockProtocols(nState);
+  return nProtocol;
+}
+
+/**
+ * Removes a protocol from the registry, built-in ones included
+ */
+bool RCSwitch::removeProtocol(int nProtocol) {
+  const InterruptState nState = lockProtocols();
+  const int nPosition = findProtocol(nProtocol);
+  if (nPosition >= 0) {
+    RCSwitch::nProtocols--;
+    for (int i = nPosition; i < RCSwitch::nProtocols; i++) {
+      RCSwitch::protocols[i] = RCSwitch::protocols[i + 1];
+    }
+  }
+  unlockProtocols(nState);
+  return nPosition >= 0;
+}
+
+/**
+ * Moves a protocol to another position in the registry. Received frames
+ * are tried with the protocols in registry order.
+ *
+ * @param nProtocol   Number of the protocol
+ * @param nPosition   New position, 0 is tried first
+ */
+bool RCSwitch::moveProtocol(int nProtocol, int nPosition) {
+  const InterruptState nState = lockProtocols();
+  const int nFrom = findProtocol(nProtocol);
+  const bool bMoved = nFrom >= 0 && nPosition >= 0 && nPosition < RCSwitch::nProtocols;
+  if (bMoved) {
+    const ProtocolEntry entry = RCSwitch::protocols[nFrom];
+    for (int i = nFrom; i < nPosition; i++) {
+      RCSwitch::protocols[i] = RCSwitch::protocols[i + 1];
+    }
+    for (int i = nFrom; i > nPosition; i--) {
+      RCSwitch::protocols[i] = RCSwitch::protocols[i - 1];
+    }
+    RCSwitch::protocols[nPosition] = entry;
+  }
+  unlockProtocols(nState);
+  return bMoved;
+}
+
+int RCSwitch::getProtocolCount() {
+  return RCSwitch::nProtocols;
+}
+
+/**
+ * Returns the number of the protocol at a registry position, -1 if there is none
+ */
+int RCSwitch::getProtocolNumber(int nPosition) {
+  const InterruptState nState = lockProtocols();
+  const int nProtocol = (nPosition >= 0 && nPosition < RCSwitch::nProtocols) ? RCSwitch::protocols[nPosition].number : -1;
+  unlockProtocols(nState);
+  return nProtocol;
+}
+
+/**
+ * Returns the registry position of a protocol, -1 if it is not registered
+ */
+int RECEIVE_ATTR RCSwitch::findProtocol(int nProtocol) {
+  for (int i = 0; i < RCSwitch::nProtocols; i++) {
+    if (RCSwitch::protocols[i].number == nProtocol) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Copies the description of a registered protocol, from PROGMEM if needed
+ */
+void RECEIVE_ATTR RCSwitch::loadProtocol(const ProtocolEntry &entry, Protocol &pro) {
+#ifdef ESP8266
+  pro = *entry.protocol;
+#else
+  if (entry.progmem) {
+    memcpy_P(&pro, entry.protocol, sizeof(Protocol));
+  } else {
+    pro = *entry.protocol;
+  }
+#endif
+}
+
+/**
+ * Appends a protocol to the registry with the lowest free number above the
+ * built-in ones. The caller has to hold the registry lock.
+ */
+int RECEIVE_ATTR RCSwitch::registerProtocol(const Protocol* protocol) {
+  if (RCSwitch::nProtocols >= RCSWITCH_MAX_PROTOCOLS) {
+    return -1;
+  }
+  int nProtocol = numProto + 1;
+  while (findProtocol(nProtocol) >= 0) {
+    nProtocol++;
+  }
+  if (nProtocol > 255) {
+    return -1;
+  }
+  ProtocolEntry &entry = RCSwitch::protocols[RCSwitch::nProtocols];
+  entry.protocol = protocol;
+  entry.number = nProtocol;
+  entry.progmem = false;
+  #if not defined( RCSwitchDisableReceiving )
+  entry.hits = 0;
+  entry.decoder = 0;
+  #endif
+  RCSwitch::nProtocols++;
+  return nProtocol;
+}
+
+/**
+ * Returns the hash of a device directory key. A device is kept in slot
+ * hash & (nSlots - 1) or, if that is taken, in one of the slots following it.
+ * The value is the same on all platforms, so directories can be built on
+ * one and stored in PROGMEM on another.
+ */
+unsigned int RCSwitch::hashDevice(unsigned long code, unsigned int bitlength, unsigned int protocol) {
+  // Fibonacci hashing, the upper bits are the well mixed ones
+  const uint32_t key = (uint32_t)code ^ ((uint32_t)(protocol & 0xFF) << 24) ^ ((uint32_t)(bitlength & 0xFF) << 16);
+  return (uint16_t)((uint32_t)(key * 2654435769UL) >> 16);
+}
+
+/**
+ * Adds a device to a directory or updates its id and action if the code,
+ * bit length and protocol are already in it.
+ *
+ * @param directory   nSlots slots, all zero initially
+ * @param nSlots      a power of two, larger than the number of devices to
+ *                    keep lookups short, e.g. twice as large
+ *
+ * @return false if the directory is full or the device has no bit length
+ */
+bool RCSwitch::addDevice(Device* directory, unsigned int nSlots, const Device &device) {
+  if (device.bitlength == 0) return false;
+  unsigned int slot = hashDevice(device.code, device.bitlength, device.protocol) & (nSlots - 1);
+  for (unsigned int i = 0; i < nSlots; i++) {
+    Device &entry = directory[slot];
+    if (entry.bitlength == 0 || (entry.code == device.code && entry.bitlength == device.bitlength &&
+                                 entry.protocol == device.protocol)) {
+      entry = device;
+      return true;
+    }
+    slot = (slot + 1) & (nSlots - 1);
+  }
+  return false;
+}
+
+/**
+ * Looks up a received code in a directory in RAM, e.g.
+ * findDevice(directory, 64, getReceivedValue(), getReceivedBitlength(), getReceivedProtocol(), device)
+ *
+ * @return false if the code is not in the directory
+ */
+bool RCSwitch::findDevice(const Device* directory, unsigned int nSlots, unsigned long code,
+                          unsigned int bitlength, unsigned int protocol, Device &device) {
+  return probeDevice(directory, nSlots, code, bitlength, protocol, device, false);
+}
+
+/**
+ * Looks up a received code in a directory stored in PROGMEM
+ */
+bool RCSwitch::findDevice_P(const Device* directory, unsigned int nSlots, unsigned long code,
+                            unsigned int bitlength, unsigned int protocol, Device &device) {
+  return probeDevice(directory, nSlots, code, bitlength, protocol, device, true);
+}
+
+bool RCSwitch::probeDevice(const Device* directory, unsigned int nSlots, unsigned long code,
+                           unsigned int bitlength, unsigned int protocol, Device &device, bool bProgmem) {
+  if (bitlength == 0) return false;
+  unsigned int slot = hashDevice(code, bitlength, protocol) & (nSlots - 1);
+  for (unsigned int i = 0; i < nSlots; i++) {
+    if (bProgmem) {
+      memcpy_P(&device, &directory[slot], sizeof(Device));
+    } else {
+      device = directory[slot];
+    }
+    if (device.bitlength == 0) return false;
+    if (device.code == code && device.bitlength == bitlength && device.protocol == protocol) return true;
+    slot = (slot + 1) & (nSlots - 1);
+  }
+  return false;
 }
 
 
@@ -185,6 +631,252 @@ void RCSwitch::setRepeatTransmit(int nRepeatTransmit) {
 void RCSwitch::setReceiveTolerance(int nPercent) {
   RCSwitch::nReceiveTolerance = nPercent;
 }
+
+/**
+ * Sets the shortest level duration in microseconds taken as a gap between
+ * two transmissions (default 3500)
+ */
+void RCSwitch::setSeparationLimit(unsigned int nMicroseconds) {
+  RCSwitch::nSeparationLimit = nMicroseconds;
+}
+
+/**
+ * Sets how much in microseconds the gaps around a frame may differ for it
+ * to be taken as a repeated transmission (default 200)
+ */
+void RCSwitch::setRepeatGapTolerance(unsigned int nMicroseconds) {
+  RCSwitch::nRepeatGapTolerance = nMicroseconds;
+}
+
+/**
+ * Keep receiving while this instance transmits, instead of disabling the
+ * receiver during send(). The receiver hears our own transmission, so its
+ * edges are dropped while our carrier is on and shortly after each of our
+ * level changes; frames from other devices in between are still decoded.
+ * A frame repeating the code we sent last is not reported for a while,
+ * e.g. when another gateway relays it.
+ *
+ * @param nEchoWindow      Microseconds after our level changes the receiver
+ *                         output may still follow them
+ * @param nHoldoffMillis   Milliseconds after our transmission frames with
+ *                         our own code are rejected
+ */
+void RCSwitch::enableReceiveWhileTransmitting(unsigned int nEchoWindow, unsigned int nHoldoffMillis) {
+  RCSwitch::nEchoWindow = nEchoWindow;
+  RCSwitch::nEchoHoldoff = nHoldoffMillis * 1000UL;
+  this->bReceiveWhileTransmitting = true;
+}
+
+void RCSwitch::disableReceiveWhileTransmitting() {
+  this->bReceiveWhileTransmitting = false;
+  RCSwitch::bEchoMasking = false;
+}
+
+/**
+ * Returns the number of receiver edges dropped as echo of our transmissions
+ */
+unsigned long RCSwitch::getEchoEdgeCount() {
+  return RCSwitch::nEchoEdges;
+}
+
+/**
+ * Returns the number of decoded frames rejected as echo of our own code
+ */
+unsigned int RCSwitch::getEchoFrameCount() {
+  return RCSwitch::nEchoFrames;
+}
+
+/**
+ * Enable gating of receiver noise. Idle receivers output noise, which makes
+ * the interrupt handler run thousands of times per second. The edges are
+ * judged in blocks; if too few of a block are plausible pulses, further
+ * edges are only checked for a gap longer than the separation limit, which
+ * restores full processing for the frame following it.
+ *
+ * @param nMinPulse            Shortest plausible pulse in microseconds
+ * @param nPlausiblePercent    Share of plausible pulses below which a
+ *                             block counts as noise
+ */
+void RCSwitch::enableNoiseGating(unsigned int nMinPulse, int nPlausiblePercent) {
+  RCSwitch::nMinPulse = nMinPulse;
+  RCSwitch::nPlausiblePercent = (nPlausiblePercent < 0) ? 0 : (nPlausiblePercent > 100) ? 100 : nPlausiblePercent;
+  RCSwitch::bGated = false;
+  RCSwitch::bNoiseGating = true;
+}
+
+void RCSwitch::disableNoiseGating() {
+  RCSwitch::bNoiseGating = false;
+  RCSwitch::bGated = false;
+}
+
+/**
+ * Returns the number of edges only checked for a gap while gated, an
+ * estimate of the interrupt time saved
+ */
+unsigned long RCSwitch::getGatedEdgeCount() {
+  return RCSwitch::nGatedEdges;
+}
+
+/**
+ * Returns the number of edges fully processed while noise gating is enabled
+ */
+unsigned long RCSwitch::getProcessedEdgeCount() {
+  return RCSwitch::nProcessedEdges;
+}
+
+/**
+ * Returns the receiver edges per second, measured over the last block
+ */
+unsigned long RCSwitch::getEdgeRate() {
+  const unsigned long nTime = RCSwitch::nGateBlockTime;
+  return (nTime > 0) ? nGateBlock * 1000000UL / nTime : 0;
+}
+
+#if RCSWITCH_SOFT_COMBINING
+/**
+ * Enable soft combining of repeated frames, which decodes weak signals
+ * whose frames all have some bits out of tolerance.
+ *
+ * Every repeat of a burst is decoded, bits out of tolerance are assigned to
+ * the nearer of the "0" and "1" timings, weighted by how much nearer. Once
+ * nFrames frames of the same protocol and length are in, every bit is
+ * decided by weighted majority and the result is reported with the vote
+ * margin of its least certain bit as getReceivedConfidence(), which is at
+ * most 100. Frames received identically twice are still reported as usual.
+ * Manchester coded protocols and frames longer than the received value
+ * (32 bit on most boards) are not combined.
+ *
+ * @param nFrames   Number of frames voted on (1..16)
+ */
+void RCSwitch::enableSoftCombining(int nFrames) {
+  RCSwitch::nSoftCount = 0;
+  RCSwitch::nSoftFrames = (nFrames < 1) ? 1 : (nFrames > 16) ? 16 : nFrames;
+}
+
+void RCSwitch::disableSoftCombining() {
+  RCSwitch::nSoftFrames = 0;
+}
+#endif
+
+/**
+ * Returns the number of frames received with a protocol
+ */
+unsigned int RCSwitch::getProtocolHits(int nProtocol) {
+  const InterruptState nState = lockProtocols();
+  const int nPosition = findProtocol(nProtocol);
+  const unsigned int nHits = (nPosition >= 0) ? RCSwitch::protocols[nPosition].hits : 0;
+  unlockProtocols(nState);
+  return nHits;
+}
+
+/**
+ * Orders the registry by the number of frames received with each protocol,
+ * so the most common protocol of a deployment is tried first
+ */
+void RCSwitch::sortProtocolsByHits() {
+  const InterruptState nState = lockProtocols();
+  for (int i = 1; i < RCSwitch::nProtocols; i++) {
+    const ProtocolEntry entry = RCSwitch::protocols[i];
+    int j = i;
+    for (; j > 0 && RCSwitch::protocols[j - 1].hits < entry.hits; j--) {
+      RCSwitch::protocols[j] = RCSwitch::protocols[j - 1];
+    }
+    RCSwitch::protocols[j] = entry;
+  }
+  unlockProtocols(nState);
+}
+
+/**
+ * Keep the registry ordered by hits while receiving. Each received frame
+ * moves its protocol at most one position ahead, so the cost stays constant.
+ */
+void RCSwitch::setProtocolAutoOrder(bool bEnable) {
+  RCSwitch::bProtocolAutoOrder = bEnable;
+}
+#endif
+
+#if RCSWITCH_LATENCY_TRACING
+/**
+ * Returns the timestamps of the last transmission
+ */
+RCSwitch::TransmitTrace RCSwitch::getTransmitTrace() {
+  return this->transmitTrace;
+}
+
+/**
+ * Returns a percentile of a latency of a protocol in microseconds, e.g.
+ * getLatencyPercentile(1, RCSwitch::LATENCY_RECEIVE, 95) for the time within
+ * which 95% of the frames received with protocol 1 were reported.
+ *
+ * Latencies are counted in buckets doubling in width, so the result is the
+ * upper bound of the bucket, at most twice the actual latency. Frames sent
+ * with a protocol set by description are not counted.
+ *
+ * @return 0 if no latency was recorded yet
+ */
+unsigned long RCSwitch::getLatencyPercentile(int nProtocol, int nLatency, int nPercent) {
+  if (nLatency < 0 || nLatency >= nLatencies) return 0;
+  if (nPercent < 1) nPercent = 1;
+  if (nPercent > 100) nPercent = 100;
+  uint8_t buckets[nLatencyBuckets];
+  const InterruptState nState = lockProtocols();
+  const int nPosition = findProtocol(nProtocol);
+  if (nPosition >= 0) {
+    memcpy(buckets, RCSwitch::protocols[nPosition].latency[nLatency], nLatencyBuckets);
+  }
+  unlockProtocols(nState);
+  if (nPosition < 0) return 0;
+
+  // up to 24 * 255 samples, times 100 exceeds a 16 bit int
+  unsigned long total = 0;
+  for (uint8_t b = 0; b < nLatencyBuckets; b++) {
+    total += buckets[b];
+  }
+  if (total == 0) return 0;
+  const unsigned long rank = (total * (unsigned long)nPercent + 99) / 100;
+  unsigned long count = 0;
+  uint8_t b = 0;
+  for (; b < nLatencyBuckets - 1; b++) {
+    count += buckets[b];
+    if (count >= rank) break;
+  }
+  return (32UL << b) - 1;
+}
+
+/**
+ * Clears the latency histograms of all protocols
+ */
+void RCSwitch::resetLatencyStats() {
+  const InterruptState nState = lockProtocols();
+  for (int i = 0; i < RCSwitch::nProtocols; i++) {
+    memset(RCSwitch::protocols[i].latency, 0, sizeof(RCSwitch::protocols[i].latency));
+  }
+  unlockProtocols(nState);
+}
+
+/**
+ * Counts a latency in the histogram of a protocol. A full bucket halves all
+ * buckets of the histogram, which keeps its shape and lets older latencies
+ * fade out.
+ */
+void RCSwitch::recordLatency(int nProtocol, int nLatency, unsigned long nMicros) {
+  uint8_t b = 0;
+  for (nMicros >>= 5; nMicros > 0 && b < nLatencyBuckets - 1; nMicros >>= 1) {
+    b++;
+  }
+  const InterruptState nState = lockProtocols();
+  const int nPosition = findProtocol(nProtocol);
+  if (nPosition >= 0) {
+    uint8_t* buckets = RCSwitch::protocols[nPosition].latency[nLatency];
+    if (buckets[b] == 255) {
+      for (uint8_t i = 0; i < nLatencyBuckets; i++) {
+        buckets[i] = (buckets[i] + 1) / 2;
+      }
+    }
+    buckets[b]++;
+  }
+  unlockProtocols(nState);
+}
 #endif
   
 
@@ -460,6 +1152,32 @@ char* RCSwitch::getCodeWordD(char sGroup, int nDevice, bool bStatus) {
   return sReturn;
 }
 
+/* number of bits send(unsigned long, unsigned int) can transmit */
+static const unsigned int nCodeBits = sizeof(unsigned long) * 8;
+
+/* helper function turning the first 'length' bits of 'code' into '0' and '1', MSB first */
+static void codeToBinString(unsigned long code, unsigned int length, char* sBinString) {
+	if (length > nCodeBits) length = nCodeBits;
+	int j=0;
+    for (int i = length-1; i >= 0; i--) {
+      if (code & (1UL << i))
+		sBinString[j]='1';
+      else
+		sBinString[j]='0';
+	  j++;
+    }
+	sBinString[j]='\0';
+}
+
+/* helper function hashing a bin string (FNV-1a), to compare it without keeping it */
+static inline unsigned long hashBinString(const char* sBinString) {
+	unsigned long hash = 2166136261UL;
+	for (const char* c = sBinString; *c; c++) {
+		hash = (hash ^ (uint8_t)*c) * 16777619UL;
+	}
+	return hash;
+}
+
 /**
  * @param sCodeWord   a tristate code word consisting of the letter 0, 1, F
  */
@@ -495,20 +1213,40 @@ void RCSwitch::send(const char* sCodeWord) {
 		return;
 
 	#if not defined( RCSwitchDisableReceiving )
-		// make sure the receiver is disabled while we transmit
+		// make sure the receiver is disabled while we transmit, unless it
+		// masks our echo
 		int nReceiverInterrupt_backup = nReceiverInterrupt;
+		if (this->bReceiveWhileTransmitting) {
+			nReceiverInterrupt_backup = -1;
+			RCSwitch::nTransmitHash = hashBinString(sCodeWord);
+			RCSwitch::bEchoMasking = true;
+		}
 		if (nReceiverInterrupt_backup != -1) {
 			this->disableReceive();
 		}
 	#endif
-	for (int nRepeat = 0; nRepeat < nRepeatTransmit; nRepeat++) {
-		this->transmit(protocol.startSyncFactor);
-		for (const char* p = sCodeWord; *p; p++) {
-			if (*p == '0') this->transmit(protocol.zero);
-			if (*p == '1') this->transmit(protocol.one);
+	#if RCSWITCH_LATENCY_TRACING
+		this->transmitTrace.started = micros();
+		if (!this->bTraceQueued) {
+			this->transmitTrace.enqueued = this->transmitTrace.started;
 		}
-		this->transmit(protocol.stopSyncFactor);
+	#endif
+	for (int nRepeat = 0; nRepeat < nRepeatTransmit; nRepeat++) {
+		this->transmitFrame(sCodeWord);
 	}
+	// Disable transmit after sending (i.e., for inverted protocols)
+	this->transmitLevel(LOW, 0);
+	#if RCSWITCH_LATENCY_TRACING
+		this->transmitTrace.finished = micros();
+		recordLatency(this->nTransmitProtocol, LATENCY_TRANSMIT, this->transmitTrace.finished - this->transmitTrace.enqueued);
+		if (this->bTraceQueued) {
+			recordLatency(this->nTransmitProtocol, LATENCY_QUEUE, this->transmitTrace.started - this->transmitTrace.enqueued);
+			this->bTraceQueued = false;
+		}
+	#endif
+	#if RCSWITCH_TX_QUEUE > 0
+		this->chargeAirtime(frameAirtime(this->protocol, sCodeWord) * nRepeatTransmit);
+	#endif
 
 	#if not defined( RCSwitchDisableReceiving )
 		// enable receiver again if we just disabled it
@@ -525,35 +1263,273 @@ void RCSwitch::send(const char* sCodeWord) {
  * then the bit at position length-2, and so on, till finally the bit at position 0.
  */
 void RCSwitch::send(unsigned long code, unsigned int length) {
-
-	char sendBinString[RCSWITCH_MAX_CHANGES/2+1];
-
-	int j=0;
-    for (int i = length-1; i >= 0; i--) {
-      if (code & (1L << i))
-		sendBinString[j]=1;
-      else
-		sendBinString[j]=0;
-	  j++;
-    }
+	char sendBinString[nCodeBits + 1];
+	codeToBinString(code, length, sendBinString);
 	this->send(sendBinString);
 }
 
 /**
- * Transmit a single high-low pulse.
+ * Returns the airtime of one frame of a binary code word with the current
+ * protocol in microseconds, sync signals included.
+ */
+unsigned long RCSwitch::getFrameAirtime(const char* sCodeWord) {
+	return frameAirtime(this->protocol, sCodeWord);
+}
+
+unsigned long RCSwitch::frameAirtime(const Protocol &pro, const char* sCodeWord) {
+	unsigned long pulses = pro.startSyncFactor.high + pro.startSyncFactor.low +
+	                       pro.stopSyncFactor.high + pro.stopSyncFactor.low;
+	for (const char* p = sCodeWord; *p; p++) {
+		if (*p == '0') pulses += pro.zero.high + pro.zero.low;
+		if (*p == '1') pulses += (pro.lineCode == MANCHESTER) ? pro.zero.high + pro.zero.low : pro.one.high + pro.one.low;
+	}
+	return pulses * pro.pulseLength;
+}
+
+#if RCSWITCH_TX_QUEUE > 0
+/**
+ * Limits the airtime of this transmitter, e.g. to 10% of any hour with
+ * setDutyCycle(100, 3600000). send() always transmits and just counts its
+ * airtime, transmitQueued() keeps queued commands within the limit.
+ *
+ * @param nPermille       Allowed share of airtime in per mille, 0 for no limit
+ * @param nWindowMillis   Window the share applies to, which is also the
+ *                        longest burst allowed after a quiet period
+ */
+void RCSwitch::setDutyCycle(unsigned int nPermille, unsigned long nWindowMillis) {
+	this->nDutyPermille = (nPermille > 1000) ? 1000 : nPermille;
+	// the budget in microseconds must fit into a long
+	if (this->nDutyPermille > 0 && nWindowMillis > 2147483647UL / this->nDutyPermille) {
+		nWindowMillis = 2147483647UL / this->nDutyPermille;
+	}
+	this->nDutyWindow = nWindowMillis;
+	// start with the whole budget
+	this->nAirtimeTokens = this->nDutyWindow * this->nDutyPermille;
+	this->nAirtimeRefill = millis();
+}
+
+/**
+ * Queues a command for transmitQueued() with the current protocol.
+ *
+ * The repeat count is adapted to the airtime budget: with enough budget
+ * nMaxRepeats frames are sent, otherwise the budget is shared among the
+ * queued commands, down to nMinRepeats.
+ *
+ * @return false if the queue is full or nMinRepeats frames exceed the whole
+ *         budget of the duty cycle
+ */
+bool RCSwitch::enqueue(unsigned long code, unsigned int length, int nMinRepeats, int nMaxRepeats) {
+	if (this->nTxQueueCount == RCSWITCH_TX_QUEUE) return false;
+	if (nMinRepeats < 1) nMinRepeats = 1;
+	if (nMinRepeats > 255) nMinRepeats = 255;
+	if (nMaxRepeats < nMinRepeats) nMaxRepeats = nMinRepeats;
+	if (length > nCodeBits) length = nCodeBits;
+	if (this->nDutyPermille > 0) {
+		// the budget never grows beyond one window, such a command would block the queue
+		char sCodeWord[nCodeBits + 1];
+		codeToBinString(code, length, sCodeWord);
+		if (frameAirtime(this->protocol, sCodeWord) * nMinRepeats > this->nDutyWindow * this->nDutyPermille) {
+			return false;
+		}
+	}
+	TransmitRequest &request = this->txQueue[(this->nTxQueueHead + this->nTxQueueCount) % RCSWITCH_TX_QUEUE];
+	request.protocol = this->protocol;
+	request.code = code;
+	request.length = length;
+	request.minRepeats = nMinRepeats;
+	request.maxRepeats = (nMaxRepeats > 255) ? 255 : nMaxRepeats;
+	#if RCSWITCH_LATENCY_TRACING
+	request.number = this->nTransmitProtocol;
+	request.enqueued = micros();
+	#endif
+	this->nTxQueueCount++;
+	return true;
+}
+
+/**
+ * Transmits the oldest queued command if the airtime budget allows it.
+ * Call it from loop(). A command that no longer fits the whole budget after
+ * setDutyCycle() is dropped.
+ *
+ * @return true if a command was transmitted
+ */
+bool RCSwitch::transmitQueued() {
+	if (this->nTxQueueCount == 0 || this->nTransmitterPin == -1) return false;
+	const TransmitRequest &request = this->txQueue[this->nTxQueueHead];
+	char sCodeWord[nCodeBits + 1];
+	codeToBinString(request.code, request.length, sCodeWord);
+	const unsigned long airtime = frameAirtime(request.protocol, sCodeWord);
+
+	int nRepeats = request.maxRepeats;
+	if (this->nDutyPermille > 0 && airtime > 0) {
+		if (airtime * request.minRepeats > this->nDutyWindow * this->nDutyPermille) {
+			this->nTxQueueHead = (this->nTxQueueHead + 1) % RCSWITCH_TX_QUEUE;
+			this->nTxQueueCount--;
+			return false;
+		}
+		this->refillAirtime();
+		if (this->nAirtimeTokens < (long)(airtime * request.minRepeats)) return false;
+		// share the budget among the waiting commands, so later ones are not starved
+		const unsigned long share = this->nAirtimeTokens / this->nTxQueueCount;
+		const unsigned long fit = share / airtime;
+		if (fit < (unsigned long)nRepeats) {
+			nRepeats = (fit < request.minRepeats) ? request.minRepeats : fit;
+		}
+	}
+
+	const Protocol protocol = this->protocol;
+	const int nRepeatTransmit = this->nRepeatTransmit;
+	this->protocol = request.protocol;
+	this->nRepeatTransmit = nRepeats;
+	this->nTxQueueHead = (this->nTxQueueHead + 1) % RCSWITCH_TX_QUEUE;
+	this->nTxQueueCount--;
+	#if RCSWITCH_LATENCY_TRACING
+	const uint8_t nTransmitProtocol = this->nTransmitProtocol;
+	this->nTransmitProtocol = request.number;
+	this->transmitTrace.enqueued = request.enqueued;
+	this->bTraceQueued = true;
+	#endif
+	this->send(sCodeWord);
+	#if RCSWITCH_LATENCY_TRACING
+	this->nTransmitProtocol = nTransmitProtocol;
+	#endif
+	this->protocol = protocol;
+	this->nRepeatTransmit = nRepeatTransmit;
+	return true;
+}
+
+int RCSwitch::getQueueLength() {
+	return this->nTxQueueCount;
+}
+
+/**
+ * Returns the airtime transmitted so far in milliseconds
+ */
+unsigned long RCSwitch::getAirtimeTotal() {
+	return this->nAirtimeMillis;
+}
+
+/**
+ * Returns the share of the duty-cycle budget in use in percent, above 100
+ * if send() overdrew it, 0 without a duty cycle.
+ */
+int RCSwitch::getAirtimeUtilization() {
+	if (this->nDutyPermille == 0 || this->nDutyWindow == 0) return 0;
+	this->refillAirtime();
+	const long capacity = this->nDutyWindow * this->nDutyPermille;
+	const long percent = capacity / 100;
+	return (percent > 0) ? (capacity - this->nAirtimeTokens) / percent : 0;
+}
+
+/**
+ * Adds the airtime earned since the last call to the budget
+ */
+void RCSwitch::refillAirtime() {
+	const unsigned long now = millis();
+	const unsigned long elapsed = now - this->nAirtimeRefill;
+	this->nAirtimeRefill = now;
+	const long capacity = this->nDutyWindow * this->nDutyPermille;
+	if (elapsed >= this->nDutyWindow) {
+		this->nAirtimeTokens = capacity;
+	} else {
+		// each millisecond earns nDutyPermille microseconds
+		this->nAirtimeTokens += elapsed * this->nDutyPermille;
+		if (this->nAirtimeTokens > capacity) this->nAirtimeTokens = capacity;
+	}
+}
+
+void RCSwitch::chargeAirtime(unsigned long nMicroseconds) {
+	this->nAirtimeMicros += nMicroseconds % 1000;
+	this->nAirtimeMillis += nMicroseconds / 1000 + this->nAirtimeMicros / 1000;
+	this->nAirtimeMicros %= 1000;
+	if (this->nDutyPermille > 0) {
+		this->refillAirtime();
+		this->nAirtimeTokens -= nMicroseconds;
+	}
+}
+#endif
+
+/**
+ * Encodes the waveform send() would transmit for a binary code word instead
+ * of transmitting it, e.g. to feed it to handleTiming().
+ *
+ * @param sCodeWord     a binary code word consisting of the letter 0, 1
+ * @param durations     receives the durations of the alternating signal
+ *                      levels in microseconds, as a receiver sees them
+ * @param nMaxDurations size of durations
+ * @param nRepeats      number of frames to encode back to back
+ *
+ * @return number of durations, -1 if they did not fit
+ */
+int RCSwitch::encodeWaveform(const char* sCodeWord, unsigned int* durations, int nMaxDurations, int nRepeats) {
+	this->pWaveform = durations;
+	this->nWaveformMax = nMaxDurations;
+	this->nWaveform = 0;
+	this->nWaveformLevel = -1;
+	for (int nRepeat = 0; nRepeat < nRepeats; nRepeat++) {
+		this->transmitFrame(sCodeWord);
+	}
+	this->pWaveform = 0;
+	return (this->nWaveform <= nMaxDurations) ? this->nWaveform : -1;
+}
+
+/**
+ * Transmit one frame: start sync, the data bits and stop sync.
+ */
+void RCSwitch::transmitFrame(const char* sCodeWord) {
+	this->transmit(protocol.startSyncFactor);
+	for (const char* p = sCodeWord; *p; p++) {
+		if (*p == '0') this->transmit(protocol.zero);
+		// a Manchester "1" mirrors the "0" waveform
+		if (*p == '1') {
+			if (protocol.lineCode == MANCHESTER) this->transmit(protocol.zero, true);
+			else this->transmit(protocol.one);
+		}
+	}
+	this->transmit(protocol.stopSyncFactor);
+}
+
+/**
+ * Transmit a single high-low pulse, or a low-high pulse if bLowFirst is set.
  */
-void RCSwitch::transmit(HighLow pulses) {
-  uint8_t firstLogicLevel = (this->protocol.invertedSignal) ? LOW : HIGH;
-  uint8_t secondLogicLevel = (this->protocol.invertedSignal) ? HIGH : LOW;
+void RCSwitch::transmit(HighLow pulses, bool bLowFirst) {
+  uint8_t firstLogicLevel = (this->protocol.invertedSignal != bLowFirst) ? LOW : HIGH;
+  uint8_t secondLogicLevel = (this->protocol.invertedSignal != bLowFirst) ? HIGH : LOW;
   
   if (pulses.high>0) {
-	digitalWrite(this->nTransmitterPin, firstLogicLevel);
-	delayMicroseconds( this->protocol.pulseLength * pulses.high);
+	this->transmitLevel(firstLogicLevel, this->protocol.pulseLength * pulses.high);
   }
   if (pulses.low>0) {
-	digitalWrite(this->nTransmitterPin, secondLogicLevel);
-	delayMicroseconds( this->protocol.pulseLength * pulses.low);
+	this->transmitLevel(secondLogicLevel, this->protocol.pulseLength * pulses.low);
+  }
+}
+
+/**
+ * Drive the transmitter to a level for some microseconds, or record it
+ * while encodeWaveform() runs.
+ */
+void RCSwitch::transmitLevel(uint8_t level, unsigned int duration) {
+  if (this->pWaveform == 0) {
+	#if not defined( RCSwitchDisableReceiving )
+	// published before the edge, so the interrupt its echo raises already
+	// sees it; the time first, so a falling edge never pairs with a stale one
+	if (this->bReceiveWhileTransmitting) {
+		RCSwitch::nTransmitEdgeTime = micros();
+		RCSwitch::nTransmitLevel = level;
+	}
+	#endif
+	digitalWrite(this->nTransmitterPin, level);
+	if (duration > 0) delayMicroseconds(duration);
+	return;
   }
+  if (level == this->nWaveformLevel) {
+	// no edge, the level just lasts longer
+	if (this->nWaveform <= this->nWaveformMax) this->pWaveform[this->nWaveform - 1] += duration;
+	return;
+  }
+  if (this->nWaveform < this->nWaveformMax) this->pWaveform[this->nWaveform] = duration;
+  this->nWaveform++;
+  this->nWaveformLevel = level;
 }
 
 
@@ -598,6 +1574,18 @@ bool RCSwitch::available() {
   }
   pthread_mutex_unlock(&thread_flag_mutex);
   #endif
+  #if RCSWITCH_LATENCY_TRACING
+  if (bTracePending && RCSwitch::nReceivedValue != 0) {
+    const InterruptState nState = lockProtocols();
+    bTracePending = false;
+    receivedTrace.delivered = micros();
+    const ReceiveTrace trace = receivedTrace;
+    const int p = RCSwitch::nReceivedProtocol;
+    unlockProtocols(nState);
+    recordLatency(p, LATENCY_RECEIVE, trace.delivered - trace.firstEdge);
+    recordLatency(p, LATENCY_DELIVERY, trace.delivered - trace.complete);
+  }
+  #endif
   return RCSwitch::nReceivedValue != 0;
 }
 
@@ -621,7 +1609,29 @@ unsigned int RCSwitch::getReceivedProtocol() {
   return RCSwitch::nReceivedProtocol;
 }
 
-unsigned int* RCSwitch::getReceivedRawdata() {
+/**
+ * Returns how sure the receiver is about the received value in percent.
+ * 100 for frames that were received identically twice, for soft combined
+ * frames the vote margin of the least certain bit.
+ */
+unsigned int RCSwitch::getReceivedConfidence() {
+  return RCSwitch::nReceivedConfidence;
+}
+
+#if RCSWITCH_LATENCY_TRACING
+/**
+ * Returns the timestamps of the last received frame. The delivery is
+ * stamped by the first available() reporting the frame.
+ */
+RCSwitch::ReceiveTrace RCSwitch::getReceivedTrace() {
+  const InterruptState nState = lockProtocols();
+  const ReceiveTrace trace = receivedTrace;
+  unlockProtocols(nState);
+  return trace;
+}
+#endif
+
+RCSwitch::Timing* RCSwitch::getReceivedRawdata() {
   return RCSwitch::timings;
 }
 
@@ -633,27 +1643,104 @@ char* RCSwitch::getLastReceiveBinString() {
   return RCSwitch::nLastReceiveBinString;
 }
 
+#if RCSWITCH_LEARNING
+/**
+ * Enable learning of unknown protocols
+ *
+ * Frames that repeat but match none of the known protocols are analysed and
+ * a protocol description is inferred from them. Once nRepeats frames agree
+ * the result is available through getLearnedProtocol().
+ *
+ * @param bRegister     Add the learned protocol to the registry, so received
+ *                      frames are decoded with it, see getLearnedProtocolNumber().
+ *                      Up to RCSWITCH_LEARNED_PROTOCOLS are registered at the
+ *                      same time, removeProtocol() makes room for more.
+ * @param nRepeats      Number of agreeing frames needed (1..255)
+ */
+void RCSwitch::enableLearning(bool bRegister, int nRepeats) {
+  RCSwitch::nLearnFrames = 0;
+  RCSwitch::nLearnRepeats = (nRepeats < 1) ? 1 : (nRepeats > 255) ? 255 : nRepeats;
+  RCSwitch::bLearnRegister = bRegister;
+  RCSwitch::bLearnedAvailable = false;
+  RCSwitch::bLearning = true;
+}
+
+/**
+ * Disable learning, an already registered learned protocol stays in use
+ */
+void RCSwitch::disableLearning() {
+  RCSwitch::bLearning = false;
+}
+
+bool RCSwitch::learnedProtocolAvailable() {
+  return RCSwitch::bLearnedAvailable;
+}
+
+/**
+ * Returns the last learned protocol, e.g. to pass it to setProtocol()
+ */
+RCSwitch::Protocol RCSwitch::getLearnedProtocol() {
+  return RCSwitch::nLearnedProtocol;
+}
+
+/**
+ * Returns the registry number of the learned protocol, -1 if it was not registered
+ */
+int RCSwitch::getLearnedProtocolNumber() {
+  const InterruptState nState = lockProtocols();
+  const int nPosition = findProtocol(RCSwitch::nLearnedNumber);
+  const bool bRegistered = nPosition >= 0 && findLearnedSlot(RCSwitch::protocols[nPosition].protocol) >= 0;
+  unlockProtocols(nState);
+  return bRegistered ? RCSwitch::nLearnedNumber : -1;
+}
+#endif
+
+#if RCSWITCH_MAX_HYPOTHESES > 0
+/**
+ * Enable decoding of frames from several transmitters sending at the same
+ * time, whose frames interleave.
+ *
+ * Every frame is decoded on its own, with the gap before or after it as
+ * sync, instead of only frames between two similar gaps. A frame is
+ * reported once it matches the previous frame of the same transmitter, told
+ * apart by sync timing and pulse length; up to RCSWITCH_MAX_HYPOTHESES
+ * transmitters are tracked.
+ */
+void RCSwitch::enableInterleavedFrames() {
+  const InterruptState nState = lockProtocols();
+  memset(RCSwitch::hypotheses, 0, sizeof(RCSwitch::hypotheses));
+  RCSwitch::bInterleavedFrames = true;
+  unlockProtocols(nState);
+}
+
+void RCSwitch::disableInterleavedFrames() {
+  RCSwitch::bInterleavedFrames = false;
+}
+#endif
+
 /* helper function for the receiveProtocol method */
 static inline unsigned int diff(int A, int B) {
   return abs(A - B);
 }
 
+/* timing window shared by all line codes */
+static inline bool matches(unsigned int timing, unsigned int expected, unsigned int tolerance) {
+  return diff(timing, expected) < tolerance;
+}
+
 /**
- *
+ * Decodes the captured timings with the given protocol, which is reported
+ * as protocol number p. Always inlined, so it folds for constant protocols.
  */
-bool RECEIVE_ATTR RCSwitch::receiveProtocol(const int p, unsigned int changeCount) {
-	if ( changeCount < 8 ) return false; // ignore very short transmissions: no device sends them, so this must be noise
-#ifdef ESP8266
-    const Protocol &pro = proto[p-1];
-#else
-    Protocol pro;
-    memcpy_P(&pro, &proto[p-1], sizeof(Protocol));
-#endif
+inline bool __attribute__((always_inline)) RCSwitch::receiveProtocol(const Protocol &pro, const int p, unsigned int changeCount) {
+	if ( changeCount < 8 ) return false;
 
     unsigned long code = 0;
     //Assuming the longer pulse length is the pulse captured in timings[0]
     const unsigned int syncLengthInPulses =  ((pro.stopSyncFactor.low) > (pro.stopSyncFactor.high)) ? (pro.stopSyncFactor.low) : (pro.stopSyncFactor.high);
-    const unsigned int delay = RCSwitch::timings[0] / syncLengthInPulses;
+    const unsigned int delayMicros = RCSwitch::nSyncDuration / syncLengthInPulses;
+    // timings are compared in ticks, see RCSWITCH_TIMING_TICK
+    const unsigned int delay = delayMicros / RCSWITCH_TIMING_TICK;
     const unsigned int delayTolerance = delay * RCSwitch::nReceiveTolerance / 100;
     
     /* For protocols that start low, the sync period looks like
@@ -676,22 +1763,57 @@ bool RECEIVE_ATTR RCSwitch::receiveProtocol(const int p, unsigned int changeCoun
     unsigned int firstDataTiming = ( (pro.invertedSignal) ? (2) : (1) );
     //printf("evaluate: pulse:%d delay:%d tolerance:%d frist:%d\n",syncLengthInPulses,delay,delayTolerance,firstDataTiming);
 
+    // Manchester: the first half bit may have merged into the low level before the data
+    const unsigned int halfBit = delay * pro.zero.high;
+    int leadingHalf = -1; // unknown
+
     if (pro.startSyncFactor.high!=0 and pro.startSyncFactor.low!=0) { // protocol use start sysnc signal test it
-        if (diff(RCSwitch::timings[firstDataTiming], delay * pro.startSyncFactor.high) > delayTolerance ||
-            diff(RCSwitch::timings[firstDataTiming + 1], delay * pro.startSyncFactor.low) > delayTolerance) return false;
+        if (diff(RCSwitch::timings[firstDataTiming], delay * pro.startSyncFactor.high) > delayTolerance) return false;
+        if (diff(RCSwitch::timings[firstDataTiming + 1], delay * pro.startSyncFactor.low) <= delayTolerance) {
+            leadingHalf = 0;
+        } else if (pro.lineCode == RCSwitch::MANCHESTER &&
+                   matches(RCSwitch::timings[firstDataTiming + 1], delay * pro.startSyncFactor.low + halfBit, delayTolerance)) {
+            leadingHalf = 1;
+        } else {
+            return false;
+        }
         firstDataTiming += 2;
+	} else if (pro.lineCode == RCSwitch::MANCHESTER && pro.invertedSignal) {
+        // the data follows the low part of the stop sync in timings[1]
+        leadingHalf = matches(RCSwitch::timings[1], delay * pro.stopSyncFactor.low + halfBit, delayTolerance) ? 1 : 0;
 	}
 	int j=0;
 	memset ( RCSwitch::nReceiveBinString, 0, RCSWITCH_MAX_CHANGES/2+1 );
+	if (pro.lineCode == RCSwitch::MANCHESTER) {
+        // after the long sync low it is unknown, so try both
+        j = receiveManchester(pro, firstDataTiming, changeCount, delay, delayTolerance, leadingHalf == 1, code);
+        if (j < 0 && leadingHalf < 0) {
+            memset ( RCSwitch::nReceiveBinString, 0, RCSWITCH_MAX_CHANGES/2+1 );
+            j = receiveManchester(pro, firstDataTiming, changeCount, delay, delayTolerance, true, code);
+        }
+        if (j < 0) return false;
+	} else {
+    // longest pulse before a gap, only checked for PULSE_POSITION
+    const unsigned int maxHigh = delay * ((pro.zero.high > pro.one.high) ? pro.zero.high : pro.one.high) + delayTolerance;
     for (unsigned int i=firstDataTiming ; i < changeCount - 1; i += 2) {
         code <<= 1;
-        if (diff(RCSwitch::timings[i], delay * pro.zero.high) < delayTolerance &&
-            diff(RCSwitch::timings[i + 1], delay * pro.zero.low) < delayTolerance) {
+        bool zero, one;
+        if (pro.lineCode == RCSwitch::PULSE_POSITION) {
+            // only the gap carries the bit, the pulse just must not be too long
+            if (RCSwitch::timings[i] > maxHigh) return false;
+            zero = matches(RCSwitch::timings[i + 1], delay * pro.zero.low, delayTolerance);
+            one = !zero && matches(RCSwitch::timings[i + 1], delay * pro.one.low, delayTolerance);
+        } else {
+            zero = matches(RCSwitch::timings[i], delay * pro.zero.high, delayTolerance) &&
+                   matches(RCSwitch::timings[i + 1], delay * pro.zero.low, delayTolerance);
+            one = !zero && matches(RCSwitch::timings[i], delay * pro.one.high, delayTolerance) &&
+                           matches(RCSwitch::timings[i + 1], delay * pro.one.low, delayTolerance);
+        }
+        if (zero) {
 			//printf("vyhodneceni: 0\n");
 			nReceiveBinString[j++]='0';
             // zero
-        } else if (diff(RCSwitch::timings[i], delay * pro.one.high) < delayTolerance &&
-                   diff(RCSwitch::timings[i + 1], delay * pro.one.low) < delayTolerance) {
+        } else if (one) {
 				   nReceiveBinString[j++]='1';
 			//printf("evaluate: 1\n");
             // one
@@ -699,43 +1821,622 @@ bool RECEIVE_ATTR RCSwitch::receiveProtocol(const int p, unsigned int changeCoun
         } else {
             // Failed
             //printf("evaluate: FALSE pulse:%d delay:%d tolerance:%d %d %d\n",syncLengthInPulses,delay,delayTolerance,RCSwitch::timings[i],RCSwitch::timings[i+1]);
+            #if RCSWITCH_SOFT_COMBINING
+            return RCSwitch::nSoftFrames > 0 && !bFrameDecoded &&
+                   softCombine(pro, p, firstDataTiming, changeCount, delay, delayTolerance, delayMicros);
+            #else
             return false;
+            #endif
         }
     }
+	}
+
+	bFrameDecoded = true;
 
 	//printf("L: %s\n",RCSwitch::nLastReceiveBinString);
 	//printf("N: %s\n",RCSwitch::nReceiveBinString);
 	//printf("C: %d\n\n",strncmp(RCSwitch::nLastReceiveBinString, RCSwitch::nReceiveBinString, RCSWITCH_MAX_CHANGES/2+1));
 	
+	const unsigned int bitlength = (pro.lineCode == RCSwitch::MANCHESTER) ? j : (changeCount - 1) / 2;
+	if (RCSwitch::bEchoMasking && isEcho(RCSwitch::nReceiveBinString)) return false;
+	#if RCSWITCH_SOFT_COMBINING
+	if (RCSwitch::nSoftFrames > 0 && pro.lineCode != RCSwitch::MANCHESTER &&
+	    softCombine(pro, p, firstDataTiming, changeCount, delay, delayTolerance, delayMicros)) {
+		return true; // the frame completed a vote
+	}
+	#endif
+	#if RCSWITCH_MAX_HYPOTHESES > 0
+	if (RCSwitch::bInterleavedFrames) {
+		if (!confirmFrame(p, delayMicros, bitlength)) return false;
+	} else
+	#endif
 	if (strncmp(RCSwitch::nLastReceiveBinString, RCSwitch::nReceiveBinString, RCSWITCH_MAX_CHANGES/2+1) !=0) {
 		strncpy( RCSwitch::nLastReceiveBinString, RCSwitch::nReceiveBinString, RCSWITCH_MAX_CHANGES/2+1);
 		return false; // packets must be min. 2 times the same
 	}
 	
+	publishFrame(code, bitlength, delayMicros, p, 100);
+	return true;
+
+}
+
+/**
+ * Makes a received frame available to the application
+ */
+void RECEIVE_ATTR RCSwitch::publishFrame(unsigned long code, unsigned int bitlength, unsigned int delayMicros, int p, unsigned int confidence) {
 	#ifdef RaspberryPi
 	pthread_mutex_lock(&thread_flag_mutex);
 	#endif
 	RCSwitch::nReceivedValue = code;
-	RCSwitch::nReceivedBitlength = (changeCount - 1) / 2;
-	RCSwitch::nReceivedDelay = delay;
+	RCSwitch::nReceivedBitlength = bitlength;
+	RCSwitch::nReceivedDelay = delayMicros;
 	RCSwitch::nReceivedProtocol = p;
+	RCSwitch::nReceivedConfidence = confidence;
+	#if RCSWITCH_LATENCY_TRACING
+	receivedTrace.complete = micros();
+	receivedTrace.firstEdge = receivedTrace.complete - nFrameDuration;
+	receivedTrace.delivered = 0;
+	bTracePending = true;
+	#endif
 	#ifdef RaspberryPi
 	//place for threader conditions set
 	pthread_cond_signal(&thread_flag_cv);
 	pthread_mutex_unlock(&thread_flag_mutex);
 	#endif
-	return true;
+}
+
+#if RCSWITCH_SOFT_COMBINING
+/**
+ * Adds the evidence of a pulse width or pulse position coded frame to the
+ * burst and votes once nSoftFrames frames are in, see enableSoftCombining().
+ * Frames with more than a quarter of the bits far off both timings or about
+ * as near to both are taken for another protocol and ignored.
+ *
+ * @return true if a voted frame was published
+ */
+bool RECEIVE_ATTR RCSwitch::softCombine(const Protocol &pro, const int p, unsigned int firstDataTiming, unsigned int changeCount,
+                                        unsigned int delay, unsigned int delayTolerance, unsigned int delayMicros) {
+    const unsigned int bits = (changeCount - firstDataTiming) / 2;
+    if (bits == 0 || bits > nSoftMaxBits) return false;
+
+    int8_t weight[nSoftMaxBits];
+    unsigned int unclear = 0;
+    for (unsigned int b = 0; b < bits; b++) {
+        const unsigned int i = firstDataTiming + 2 * b;
+        unsigned long dZero = diff(RCSwitch::timings[i + 1], delay * pro.zero.low);
+        unsigned long dOne = diff(RCSwitch::timings[i + 1], delay * pro.one.low);
+        if (pro.lineCode != RCSwitch::PULSE_POSITION) {
+            dZero += diff(RCSwitch::timings[i], delay * pro.zero.high);
+            dOne += diff(RCSwitch::timings[i], delay * pro.one.high);
+        }
+        // positive for "1", the nearer the timings the larger
+        weight[b] = (dZero + dOne > 0) ? ((long)dZero - (long)dOne) * nSoftWeight / (long)(dZero + dOne) : 0;
+        if ((dZero < dOne ? dZero : dOne) > 2UL * delayTolerance ||
+            (weight[b] < 0 ? -weight[b] : weight[b]) < nSoftWeight / 2) unclear++;
+    }
+    if (unclear * 4 > bits) return false;
+    bFrameDecoded = true;
+
+    if (RCSwitch::nSoftCount == 0 || RCSwitch::nSoftProtocol != p || RCSwitch::nSoftBits != bits ||
+        RCSwitch::nReceiveTime - RCSwitch::nSoftTime > nSoftTimeout) {
+        // another burst
+        memset(RCSwitch::softEvidence, 0, sizeof(RCSwitch::softEvidence));
+        RCSwitch::nSoftCount = 0;
+        RCSwitch::nSoftProtocol = p;
+        RCSwitch::nSoftBits = bits;
+    }
+    // at most nSoftWeight * 16 frames, no need to saturate
+    for (unsigned int b = 0; b < bits; b++) {
+        RCSwitch::softEvidence[b] += weight[b];
+    }
+    RCSwitch::nSoftTime = RCSwitch::nReceiveTime;
+    if (++RCSwitch::nSoftCount < RCSwitch::nSoftFrames) return false;
+
+    RCSwitch::nSoftCount = 0;
+    unsigned long code = 0;
+    unsigned int margin = nSoftWeight * RCSwitch::nSoftFrames;
+    char sBinString[nSoftMaxBits + 1];
+    for (unsigned int b = 0; b < bits; b++) {
+        const int evidence = RCSwitch::softEvidence[b];
+        const unsigned int magnitude = (evidence < 0) ? -evidence : evidence;
+        if (magnitude < margin) margin = magnitude;
+        code = (code << 1) | (evidence > 0 ? 1 : 0);
+        sBinString[b] = (evidence > 0) ? '1' : '0';
+    }
+    sBinString[bits] = '\0';
+    if (margin == 0) return false; // a tie, no decision
+    if (RCSwitch::bEchoMasking && isEcho(sBinString)) return false;
+    strcpy(RCSwitch::nReceiveBinString, sBinString);
+
+    const unsigned int confidence = margin * 100 / (nSoftWeight * RCSwitch::nSoftFrames);
+    // same bit length as reported for frames decoded without voting
+    publishFrame(code, (changeCount - 1) / 2, delayMicros, p, (confidence > 100) ? 100 : confidence);
+    return true;
+}
+#endif
+
+/**
+ * Returns true if a received frame repeats the code we sent last within
+ * nEchoHoldoff, see enableReceiveWhileTransmitting()
+ */
+bool RECEIVE_ATTR RCSwitch::isEcho(const char* sBinString) {
+  if (micros() - RCSwitch::nTransmitEdgeTime >= RCSwitch::nEchoHoldoff) return false;
+  if (hashBinString(sBinString) != RCSwitch::nTransmitHash) return false;
+  RCSwitch::nEchoFrames++;
+  return true;
+}
+
+/**
+ * Decodes Manchester coded data starting at firstDataTiming into code and
+ * nReceiveBinString.
+ *
+ * Each timing covers one or two half bits. Half bits of the same level
+ * merge, also with the sync signals around the data: a leading low half bit
+ * into the preceding low (bLeadingHalf), a trailing high half bit into the
+ * high part of the stop sync.
+ *
+ * @return number of bits, -1 if the timings are not Manchester coded
+ */
+inline int __attribute__((always_inline)) RCSwitch::receiveManchester(const Protocol &pro, unsigned int firstDataTiming, unsigned int changeCount,
+                                                                       unsigned int delay, unsigned int delayTolerance, bool bLeadingHalf, unsigned long &code) {
+    const unsigned int halfBit = delay * pro.zero.high;
+    // one and two half bits must stay apart
+    const unsigned int tolerance = (delayTolerance < halfBit / 2) ? delayTolerance : halfBit / 2;
+    int pending = bLeadingHalf ? LOW : -1; // level of the first half of the current bit
+    int j = 0;
+    code = 0;
+    for (unsigned int i = firstDataTiming; i < changeCount; i++) {
+        // data always starts high, after the low part of a sync signal
+        const int level = ((i - firstDataTiming) & 1) ? LOW : HIGH;
+        unsigned int halves;
+        if (i == changeCount - 1 && !pro.invertedSignal) {
+            // high part of the stop sync
+            if (matches(RCSwitch::timings[i], delay * pro.stopSyncFactor.high, tolerance)) {
+                halves = 0;
+            } else if (matches(RCSwitch::timings[i], delay * pro.stopSyncFactor.high + halfBit, tolerance)) {
+                halves = 1;
+            } else {
+                return -1;
+            }
+        } else if (matches(RCSwitch::timings[i], halfBit, tolerance)) {
+            halves = 1;
+        } else if (matches(RCSwitch::timings[i], 2 * halfBit, tolerance)) {
+            halves = 2;
+        } else {
+            return -1;
+        }
+        for (; halves > 0; halves--) {
+            if (pending < 0) {
+                pending = level;
+                continue;
+            }
+            if (pending == level || j >= RCSWITCH_MAX_CHANGES/2) return -1;
+            code <<= 1;
+            if (pending == LOW) {
+                code |= 1;
+                RCSwitch::nReceiveBinString[j++] = '1';
+            } else {
+                RCSwitch::nReceiveBinString[j++] = '0';
+            }
+            pending = -1;
+        }
+    }
+    if (pending == LOW && pro.invertedSignal && j < RCSWITCH_MAX_CHANGES/2) {
+        // the final high half bit merged into the stop sync gap
+        code = (code << 1) | 1;
+        RCSwitch::nReceiveBinString[j++] = '1';
+        pending = -1;
+    }
+    return (pending < 0) ? j : -1;
+}
+
+/**
+ * Decoder specialized for built-in protocol P
+ */
+template <int P>
+bool RECEIVE_ATTR RCSwitch::receiveBuiltin(unsigned int changeCount) {
+    return receiveProtocol(BuiltinProtocol<P>::get(), P, changeCount);
+}
+
+/**
+ * Decodes the captured timings with a registered protocol and counts the hit
+ */
+bool RECEIVE_ATTR RCSwitch::receiveProtocol(ProtocolEntry &entry, unsigned int changeCount) {
+	if ( changeCount < 8 ) return false; // ignore very short transmissions: no device sends them, so this must be noise
+    if (entry.decoder) {
+        if (!entry.decoder(changeCount)) return false;
+    } else {
+        Protocol pro;
+        loadProtocol(entry, pro);
+        if (!receiveProtocol(pro, entry.number, changeCount)) return false;
+    }
+    if (entry.hits == 0xFFFF) {
+        // age all counters, this keeps their ratio
+        for (unsigned int i = 0; i < RCSwitch::nProtocols; i++) {
+            RCSwitch::protocols[i].hits >>= 1;
+        }
+    }
+    entry.hits++;
+    return true;
+}
+
+/**
+ * Tries the registered protocols in order on the captured frame, sets
+ * bFrameDecoded if one matched. The caller holds protocols_mutex on the Pi.
+ */
+void RECEIVE_ATTR RCSwitch::decodeFrame(unsigned int changeCount) {
+  bFrameDecoded = false;
+  for(unsigned int i = 0; i < RCSwitch::nProtocols; i++) {
+    if (receiveProtocol(RCSwitch::protocols[i], changeCount)) {
+      // receive succeeded for the protocol at position i
+      if (RCSwitch::bProtocolAutoOrder && i > 0 &&
+          RCSwitch::protocols[i].hits > RCSwitch::protocols[i - 1].hits) {
+        const ProtocolEntry entry = RCSwitch::protocols[i];
+        RCSwitch::protocols[i] = RCSwitch::protocols[i - 1];
+        RCSwitch::protocols[i - 1] = entry;
+      }
+      break;
+    }
+  }
+}
+
+#if RCSWITCH_MAX_HYPOTHESES > 0
+/**
+ * Decodes a frame that may be interleaved with frames of other transmitters.
+ *
+ * The gap before the frame may then belong to another transmitter. The stop
+ * sync is always sent after the data, so the frame ends with its own sync,
+ * lengthened by any pause before the next transmission. The sync timings of
+ * the known transmitters that fit into the gap are tried first, each with
+ * its own protocol only, then all protocols with the gap itself as sync.
+ *
+ * @param gap   Microseconds of the gap ending the frame
+ */
+void RECEIVE_ATTR RCSwitch::decodeInterleaved(unsigned int changeCount, unsigned int gap) {
+  bFrameDecoded = false;
+  for (unsigned int i = 0; i < RCSWITCH_MAX_HYPOTHESES && !bFrameDecoded; i++) {
+    const FrameHypothesis &h = RCSwitch::hypotheses[i];
+    if (h.frames == 0 || RCSwitch::nReceiveTime - h.lastTime > nHypothesisTimeout ||
+        gap + RCSwitch::nRepeatGapTolerance < h.syncDuration) continue;
+    const int nPosition = findProtocol(h.protocol);
+    if (nPosition < 0) continue;
+    RCSwitch::nSyncDuration = h.syncDuration;
+    receiveProtocol(RCSwitch::protocols[nPosition], changeCount);
+  }
+  RCSwitch::nSyncDuration = gap;
+  if (!bFrameDecoded) decodeFrame(changeCount);
+}
+
+/**
+ * Confirms a decoded frame against the hypotheses, which are keyed by
+ * protocol, sync timing and pulse length and hold the last code seen with
+ * them. A frame matching none starts a new hypothesis in place of the least
+ * recent one, so several transmitters confirm independently, even ones
+ * using the same protocol.
+ *
+ * @return true if the frame repeats the code of its hypothesis
+ */
+bool RECEIVE_ATTR RCSwitch::confirmFrame(const int p, unsigned int delayMicros, unsigned int bitlength) {
+  // stands in for the whole bin string
+  const unsigned long hash = hashBinString(RCSwitch::nReceiveBinString);
+  const unsigned long delayTolerance = (unsigned long)delayMicros * RCSwitch::nReceiveTolerance / 100;
+
+  FrameHypothesis* slot = 0;
+  FrameHypothesis* oldest = &RCSwitch::hypotheses[0];
+  for (unsigned int i = 0; i < RCSWITCH_MAX_HYPOTHESES; i++) {
+    FrameHypothesis &h = RCSwitch::hypotheses[i];
+    if (h.frames > 0 && RCSwitch::nReceiveTime - h.lastTime > nHypothesisTimeout) {
+      h.frames = 0; // the transmitter went quiet
+    }
+    if (h.frames > 0 && h.protocol == p && h.hash == hash && h.bitlength == bitlength &&
+        diff(h.syncDuration, RCSwitch::nSyncDuration) < RCSwitch::nRepeatGapTolerance &&
+        diff(h.pulseLength, delayMicros) <= delayTolerance) {
+      slot = &h;
+      break;
+    }
+    if (oldest->frames > 0 &&
+        (h.frames == 0 || RCSwitch::nReceiveTime - h.lastTime > RCSwitch::nReceiveTime - oldest->lastTime)) {
+      oldest = &h;
+    }
+  }
+
+  if (slot == 0) {
+    slot = oldest;
+    slot->protocol = p;
+    slot->hash = hash;
+    slot->bitlength = bitlength;
+    slot->frames = 0;
+  }
+  if (slot->frames < 255) slot->frames++;
+  // follow slow drift of the transmitter
+  slot->syncDuration = RCSwitch::nSyncDuration;
+  slot->pulseLength = delayMicros;
+  slot->lastTime = RCSwitch::nReceiveTime;
+  return slot->frames >= 2;
+}
+#endif
 
+#if RCSWITCH_LEARNING
+/* helper function for inferProtocol, rounds a timing to a multiple of base */
+static inline uint8_t quantize(unsigned int timing, unsigned int base) {
+  const unsigned int factor = (timing + base / 2) / base;
+  return (factor > 255) ? 0 : factor;
 }
 
+/**
+ * Infers a protocol from the frame captured in timings[].
+ *
+ * The durations are clustered, the base pulse length is taken as the
+ * largest common divisor of the cluster centers and the high/low pairs are
+ * then classified for both signal polarities. A valid frame consists of
+ * exactly two data symbols, optionally led by a single start sync symbol.
+ * The shorter symbol becomes the "0" bit.
+ */
+bool RECEIVE_ATTR RCSwitch::inferProtocol(unsigned int changeCount, Protocol &pro) {
+  if ( changeCount < 8 ) return false;
+
+  unsigned long clusterSum[nLearnClusters];
+  unsigned int clusterCount[nLearnClusters];
+  unsigned int clusters = 0;
+  for (unsigned int i = 1; i < changeCount; i++) {
+    const unsigned int timing = RCSwitch::timings[i];
+    unsigned int c;
+    for (c = 0; c < clusters; c++) {
+      const unsigned int center = clusterSum[c] / clusterCount[c];
+      if (diff(timing, center) <= center / 4) break;
+    }
+    if (c == clusters) {
+      if (clusters == nLearnClusters) return false; // too many distinct durations, must be noise
+      clusterSum[c] = 0;
+      clusterCount[c] = 0;
+      clusters++;
+    }
+    clusterSum[c] += timing;
+    clusterCount[c]++;
+  }
+
+  unsigned int shortest = nTimingMax;
+  for (unsigned int c = 0; c < clusters; c++) {
+    const unsigned int center = clusterSum[c] / clusterCount[c];
+    if (center < shortest) shortest = center;
+  }
+
+  // the shortest duration may span several base pulses, e.g. 4 for protocol 3
+  unsigned int base = 0;
+  for (unsigned int k = 1; k <= 4 && base == 0; k++) {
+    base = shortest / k;
+    if (base == 0) return false;
+    for (unsigned int c = 0; c < clusters; c++) {
+      const unsigned int center = clusterSum[c] / clusterCount[c];
+      const uint8_t factor = quantize(center, base);
+      if (factor == 0 || diff(center, factor * base) > base / 4) {
+        base = 0;
+        break;
+      }
+    }
+  }
+  if (base == 0) return false;
+
+  const unsigned int pulseLength = base * RCSWITCH_TIMING_TICK;
+  const unsigned int syncFactor = (RCSwitch::nSyncDuration + pulseLength / 2) / pulseLength;
+  if (syncFactor == 0 || syncFactor > 255) return false;
+
+  // data starts at timings[1] for normal and at timings[2] for inverted signals
+  for (unsigned int firstDataTiming = 1; firstDataTiming <= 2; firstDataTiming++) {
+    HighLow symbol[3];
+    unsigned int symbolCount[3];
+    unsigned int symbols = 0;
+    bool valid = true;
+    for (unsigned int i = firstDataTiming; i < changeCount - 1 && valid; i += 2) {
+      const HighLow pulse = { quantize(RCSwitch::timings[i], base), quantize(RCSwitch::timings[i + 1], base) };
+      unsigned int s;
+      for (s = 0; s < symbols; s++) {
+        if (symbol[s].high == pulse.high && symbol[s].low == pulse.low) break;
+      }
+      if (s == symbols) {
+        if (symbols == 3 || pulse.high == 0 || pulse.low == 0) {
+          valid = false;
+          break;
+        }
+        symbol[s] = pulse;
+        symbolCount[s] = 0;
+        symbols++;
+      }
+      symbolCount[s]++;
+    }
+
+    unsigned int firstData = 0;
+    if (symbols == 3 && symbolCount[0] == 1) {
+      firstData = 1; // a third symbol is only accepted as start sync
+    } else if (symbols != 2) {
+      valid = false;
+    }
+    if (!valid) continue;
+
+    const HighLow zero = symbol[firstData];
+    const HighLow one = symbol[firstData + 1];
+    const bool swap = (one.high < zero.high) || (one.high == zero.high && one.low < zero.low);
+
+    pro.pulseLength = pulseLength;
+    pro.startSyncFactor.high = (firstData == 1) ? symbol[0].high : 0;
+    pro.startSyncFactor.low = (firstData == 1) ? symbol[0].low : 0;
+    pro.zero = swap ? one : zero;
+    pro.one = swap ? zero : one;
+    if (firstDataTiming == 1) {
+      pro.stopSyncFactor.high = quantize(RCSwitch::timings[changeCount - 1], base);
+      pro.stopSyncFactor.low = syncFactor;
+    } else {
+      pro.stopSyncFactor.high = syncFactor;
+      pro.stopSyncFactor.low = quantize(RCSwitch::timings[1], base);
+    }
+    pro.invertedSignal = (firstDataTiming == 2);
+    pro.shift = 0;
+    pro.lineCode = PULSE_WIDTH;
+    return true;
+  }
+  return false;
+}
+
+/* helper function for learnFrame, compares two protocols except for the pulse length */
+static inline bool sameShape(const RCSwitch::Protocol &a, const RCSwitch::Protocol &b) {
+  return a.startSyncFactor.high == b.startSyncFactor.high && a.startSyncFactor.low == b.startSyncFactor.low &&
+         a.zero.high == b.zero.high && a.zero.low == b.zero.low &&
+         a.one.high == b.one.high && a.one.low == b.one.low &&
+         diff(a.stopSyncFactor.high, b.stopSyncFactor.high) <= 1 &&
+         diff(a.stopSyncFactor.low, b.stopSyncFactor.low) <= 1 &&
+         a.invertedSignal == b.invertedSignal;
+}
+
+/**
+ * Feeds a frame no protocol could decode to the protocol learner
+ */
+void RECEIVE_ATTR RCSwitch::learnFrame(unsigned int changeCount) {
+  Protocol pro;
+  if (!inferProtocol(changeCount, pro)) return;
+
+  if (RCSwitch::nLearnFrames == 0 || changeCount != RCSwitch::nLearnChangeCount ||
+      !sameShape(pro, RCSwitch::nLearnCandidate) ||
+      diff(pro.pulseLength, RCSwitch::nLearnCandidate.pulseLength) > RCSwitch::nLearnCandidate.pulseLength / 4) {
+    // different frame, start over with it
+    RCSwitch::nLearnCandidate = pro;
+    RCSwitch::nLearnChangeCount = changeCount;
+    RCSwitch::nLearnPulseSum = 0;
+    RCSwitch::nLearnFrames = 0;
+  }
+  RCSwitch::nLearnPulseSum += pro.pulseLength;
+  RCSwitch::nLearnFrames++;
+
+  if (RCSwitch::nLearnFrames >= RCSwitch::nLearnRepeats) {
+    RCSwitch::nLearnCandidate.pulseLength = RCSwitch::nLearnPulseSum / RCSwitch::nLearnFrames;
+    RCSwitch::nLearnedProtocol = RCSwitch::nLearnCandidate;
+    RCSwitch::nLearnFrames = 0;
+    RCSwitch::bLearnedAvailable = true;
+    if (RCSwitch::bLearnRegister) {
+      // a protocol learned before is only registered once
+      int nProtocol = -1;
+      bool bSlotUsed[RCSWITCH_LEARNED_PROTOCOLS] = { false };
+      for (int i = 0; i < RCSwitch::nProtocols; i++) {
+        const int nSlot = findLearnedSlot(RCSwitch::protocols[i].protocol);
+        if (nSlot < 0) continue;
+        bSlotUsed[nSlot] = true;
+        const Protocol &learned = RCSwitch::learnedProtocols[nSlot];
+        if (sameShape(learned, RCSwitch::nLearnedProtocol) &&
+            diff(learned.pulseLength, RCSwitch::nLearnedProtocol.pulseLength) <= learned.pulseLength / 4) {
+          nProtocol = RCSwitch::protocols[i].number;
+        }
+      }
+      // registry entries point at their description, so each gets its own copy
+      for (int nSlot = 0; nProtocol < 0 && nSlot < RCSWITCH_LEARNED_PROTOCOLS; nSlot++) {
+        if (bSlotUsed[nSlot]) continue;
+        RCSwitch::learnedProtocols[nSlot] = RCSwitch::nLearnedProtocol;
+        nProtocol = registerProtocol(&RCSwitch::learnedProtocols[nSlot]);
+        if (nProtocol < 0) break;
+      }
+      RCSwitch::nLearnedNumber = (nProtocol > 0) ? nProtocol : 0;
+    }
+  }
+}
+
+/**
+ * Returns the slot in learnedProtocols a description is stored in, -1 if it
+ * is not a registered learned protocol
+ */
+int RECEIVE_ATTR RCSwitch::findLearnedSlot(const Protocol* protocol) {
+  for (int nSlot = 0; nSlot < RCSWITCH_LEARNED_PROTOCOLS; nSlot++) {
+    if (protocol == &RCSwitch::learnedProtocols[nSlot]) return nSlot;
+  }
+  return -1;
+}
+#endif
+
 void RECEIVE_ATTR RCSwitch::handleInterrupt() {
   if (EnableReceiver == false) return;										// if no enabled interrupt receiver fast end
-  static unsigned int changeCount = 0;
   static unsigned long lastTime = 0;
-  static unsigned int repeatCount = 0;
 
   const long time = micros();
   const unsigned int duration = time - lastTime;
+  lastTime = time;
+
+  if (RCSwitch::bEchoMasking &&
+      (RCSwitch::nTransmitLevel == HIGH || time - RCSwitch::nTransmitEdgeTime < RCSwitch::nEchoWindow)) {
+    // the receiver follows our own carrier, whatever it captured is lost
+    RCSwitch::nEchoEdges++;
+    bCaptureReset = true;
+    // dropped edges still advance the receive time, handleTiming() does it otherwise
+    RCSwitch::nReceiveTime += duration;
+    return;
+  }
+  if (RCSwitch::bNoiseGating && gateNoise(duration)) {
+    RCSwitch::nReceiveTime += duration;
+    return;
+  }
+
+  handleTiming(duration);
+}
+
+/**
+ * Keeps the block statistics of the noise gating
+ *
+ * @return true if the edge is gated, i.e. must not be processed
+ */
+bool RECEIVE_ATTR RCSwitch::gateNoise(unsigned int duration) {
+  static uint8_t nBlockEdges = 0;
+  static uint8_t nBlockPlausible = 0;
+  static unsigned long nBlockTime = 0;
+
+  nBlockEdges++;
+  nBlockTime += duration;
+  if (duration >= RCSwitch::nMinPulse) nBlockPlausible++;
+  if (nBlockEdges == nGateBlock) {
+    if (!RCSwitch::bGated && nBlockPlausible * 100U < RCSwitch::nPlausiblePercent * (unsigned int)nGateBlock) {
+      // noise, whatever was captured is lost
+      RCSwitch::bGated = true;
+      bCaptureReset = true;
+    }
+    RCSwitch::nGateBlockTime = nBlockTime;
+    nBlockEdges = 0;
+    nBlockPlausible = 0;
+    nBlockTime = 0;
+  }
+
+  if (RCSwitch::bGated) {
+    if (duration <= RCSwitch::nSeparationLimit) {
+      RCSwitch::nGatedEdges++;
+      return true;
+    }
+    // a sync-like gap, judge the frame following it from scratch
+    RCSwitch::bGated = false;
+    nBlockEdges = 0;
+    nBlockPlausible = 0;
+    nBlockTime = 0;
+  }
+  RCSwitch::nProcessedEdges++;
+  return false;
+}
+
+/**
+ * Feeds the duration of one signal level to the receiver, as the interrupt
+ * handler does on every level change. Can be used to decode timings from
+ * another source, e.g. synthesized or recorded frames, without enabling
+ * the receiver.
+ *
+ * @param duration    Microseconds since the previous level change
+ */
+void RECEIVE_ATTR RCSwitch::handleTiming(unsigned int duration) {
+  static unsigned int changeCount = 0;
+  static unsigned int repeatCount = 0;
+  #if RCSWITCH_LATENCY_TRACING
+  // microseconds since the end of timings[0], i.e. the first edge of the frame
+  static unsigned long nCaptureTime = 0;
+  nFrameDuration = nCaptureTime + duration;
+  #endif
+
+  RCSwitch::nReceiveTime += duration;
+  if (bCaptureReset) {
+    bCaptureReset = false;
+    changeCount = 0;
+    repeatCount = 0;
+  }
 
   //printf("Handle interrupt (OL)%d\n", duration);
   //printf("%d\n", duration);
@@ -743,21 +2444,48 @@ void RECEIVE_ATTR RCSwitch::handleInterrupt() {
 	//printf("Exceeding the time limit: %d %d\n", changeCount,RCSwitch::timings[0]);
     // A long stretch without signal level change occurred. This could
     // be the gap between two transmission.
-    if (diff(duration, RCSwitch::timings[0]) < 200) {
+    #if RCSWITCH_MAX_HYPOTHESES > 0
+    if (RCSwitch::bInterleavedFrames) {
+      #ifdef RaspberryPi
+      pthread_mutex_lock(&protocols_mutex);
+      #endif
+      decodeInterleaved(changeCount, duration);
+      #if RCSWITCH_LEARNING
+      if (!bFrameDecoded && RCSwitch::bLearning) {
+        learnFrame(changeCount);
+      }
+      #endif
+      #ifdef RaspberryPi
+      pthread_mutex_unlock(&protocols_mutex);
+      #endif
+    } else
+    #endif
+    if (diff(duration, RCSwitch::nSyncDuration) < RCSwitch::nRepeatGapTolerance) {
       // This long signal is close in length to the long signal which
       // started the previously recorded timings; this suggests that
       // it may indeed by a a gap between two transmissions (we assume
       // here that a sender will send the signal multiple times,
       // with roughly the same gap between them).
       repeatCount++;
+      #if RCSWITCH_SOFT_COMBINING
+      // soft combining needs every repeat, not only every second one
+      if (repeatCount == 2 || RCSwitch::nSoftFrames > 0) {
+      #else
       if (repeatCount == 2) {
+      #endif
 		//printf("Do evaluate: %d\n", changeCount);
-        for(unsigned int i = 1; i <= numProto; i++) {
-          if (receiveProtocol(i, changeCount)) {
-            // receive succeeded for protocol i
-            break;
-          }
+        #ifdef RaspberryPi
+        pthread_mutex_lock(&protocols_mutex);
+        #endif
+        decodeFrame(changeCount);
+        #if RCSWITCH_LEARNING
+        if (!bFrameDecoded && RCSwitch::bLearning) {
+          learnFrame(changeCount);
         }
+        #endif
+        #ifdef RaspberryPi
+        pthread_mutex_unlock(&protocols_mutex);
+        #endif
         repeatCount = 0;
       }
     }
@@ -770,7 +2498,13 @@ void RECEIVE_ATTR RCSwitch::handleInterrupt() {
     repeatCount = 0;
   }
 
-  RCSwitch::timings[changeCount++] = duration;
-  lastTime = time;  
+  if (changeCount == 0) {
+    RCSwitch::nSyncDuration = duration;
+  }
+  #if RCSWITCH_LATENCY_TRACING
+  nCaptureTime = (changeCount == 0) ? 0 : nFrameDuration;
+  #endif
+  const unsigned int ticks = duration / RCSWITCH_TIMING_TICK;
+  RCSwitch::timings[changeCount++] = (ticks > nTimingMax) ? nTimingMax : ticks;
 }
 #endif
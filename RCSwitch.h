@@ -61,11 +61,91 @@
 
 // Number of maximum high/Low changes per packet.
 // We can handle up to (unsigned long) => 32 bit * 2 H/L changes per bit + 2 for sync
+// Define it before compiling the library (e.g. -DRCSWITCH_MAX_CHANGES=67 for
+// codes up to 32 bit) to shrink the receive buffers.
+#ifndef RCSWITCH_MAX_CHANGES
 #define RCSWITCH_MAX_CHANGES 300
+#endif
+
+// Storage of the captured timings. Each high/low duration is kept as
+// RCSWITCH_TIMING_TYPE in units of RCSWITCH_TIMING_TICK microseconds and
+// saturates at the largest value of the type. The defaults keep plain
+// microseconds; e.g. uint8_t with 4 us ticks halves the buffer on AVR (and
+// quarters it on 32 bit targets) while still resolving pulses up to 1020 us.
+#ifndef RCSWITCH_TIMING_TYPE
+#define RCSWITCH_TIMING_TYPE unsigned int
+#endif
+#ifndef RCSWITCH_TIMING_TICK
+#define RCSWITCH_TIMING_TICK 1
+#endif
+
+// Built-in protocols compiled in, bit n-1 selects protocol n. Protocols not
+// selected cost neither flash nor decoding time, e.g. 0x41 keeps 1 and 7.
+// All protocols share one generic decoder. Defining
+// RCSWITCH_SPECIALIZED_DECODERS gives each selected protocol its own faster
+// decoder instead, at about 550 bytes of flash (IRAM on the ESP8266) each.
+#ifndef RCSWITCH_PROTOCOLS
+#define RCSWITCH_PROTOCOLS 0x7F
+#endif
+
+// Number of protocols the registry can hold, the built-in ones included. The
+// ATtiny only gets room for two protocols beyond the selected built-in ones.
+#ifndef RCSWITCH_MAX_PROTOCOLS
+#if defined( __AVR_ATtinyX5__ ) or defined ( __AVR_ATtinyX4__ )
+#define RCSWITCH_MAX_PROTOCOLS (((RCSWITCH_PROTOCOLS >> 0) & 1) + ((RCSWITCH_PROTOCOLS >> 1) & 1) + \
+                                ((RCSWITCH_PROTOCOLS >> 2) & 1) + ((RCSWITCH_PROTOCOLS >> 3) & 1) + \
+                                ((RCSWITCH_PROTOCOLS >> 4) & 1) + ((RCSWITCH_PROTOCOLS >> 5) & 1) + \
+                                ((RCSWITCH_PROTOCOLS >> 6) & 1) + 2)
+#else
+#define RCSWITCH_MAX_PROTOCOLS 12
+#endif
+#endif
+
+// Learning of unknown protocols, see enableLearning(). Define it as 1 to add
+// it; 0, the default, leaves the learner and its interrupt code out.
+#ifndef RCSWITCH_LEARNING
+#define RCSWITCH_LEARNING 0
+#endif
+
+// Number of learned protocols that can be registered at the same time, see
+// enableLearning(). Each keeps its own copy of the learned description.
+#ifndef RCSWITCH_LEARNED_PROTOCOLS
+#define RCSWITCH_LEARNED_PROTOCOLS 2
+#endif
+
+// Number of transmitters whose frames can be tracked at the same time while
+// interleaved frames are enabled, see enableInterleavedFrames(). 0 leaves
+// interleaved frame decoding out, which is the default; e.g. 4 adds it.
+#ifndef RCSWITCH_MAX_HYPOTHESES
+#define RCSWITCH_MAX_HYPOTHESES 0
+#endif
+
+// Number of commands the transmit scheduler can queue, see enqueue(). 0
+// leaves the scheduler and duty-cycle accounting out, which is the default;
+// e.g. 4 adds it.
+#ifndef RCSWITCH_TX_QUEUE
+#define RCSWITCH_TX_QUEUE 0
+#endif
+
+// Soft combining of repeated frames, see enableSoftCombining(). Define it
+// as 1 to add it, it costs about 80 bytes of RAM and interrupt code.
+#ifndef RCSWITCH_SOFT_COMBINING
+#define RCSWITCH_SOFT_COMBINING 0
+#endif
+
+// Latency tracing, see getLatencyPercentile(). Define it as 1 to timestamp
+// received and transmitted frames and to keep latency histograms per
+// protocol, which cost about 100 bytes of RAM per RCSWITCH_MAX_PROTOCOLS.
+#ifndef RCSWITCH_LATENCY_TRACING
+#define RCSWITCH_LATENCY_TRACING 0
+#endif
 
 class RCSwitch {
 
   public:
+    /** type of a captured timing, see RCSWITCH_TIMING_TYPE */
+    typedef RCSWITCH_TIMING_TYPE Timing;
+
     RCSwitch();
     
     void switchOn(int nGroupNumber, int nSwitchNumber);
@@ -82,6 +162,17 @@ class RCSwitch {
     void sendTriState(const char* sCodeWord);
     void send(unsigned long code, unsigned int length);
     void send(const char* sCodeWord);
+    int encodeWaveform(const char* sCodeWord, unsigned int* durations, int nMaxDurations, int nRepeats = 1);
+    unsigned long getFrameAirtime(const char* sCodeWord);
+
+    #if RCSWITCH_TX_QUEUE > 0
+    void setDutyCycle(unsigned int nPermille, unsigned long nWindowMillis = 3600000UL);
+    bool enqueue(unsigned long code, unsigned int length, int nMinRepeats = 1, int nMaxRepeats = 10);
+    bool transmitQueued();
+    int getQueueLength();
+    unsigned long getAirtimeTotal();
+    int getAirtimeUtilization();
+    #endif
     
     #if not defined( RCSwitchDisableReceiving )
     void enableReceive(int interrupt);
@@ -94,9 +185,11 @@ class RCSwitch {
     unsigned int getReceivedBitlength();
     unsigned int getReceivedDelay();
     unsigned int getReceivedProtocol();
-    unsigned int* getReceivedRawdata();
+    unsigned int getReceivedConfidence();
+    Timing* getReceivedRawdata();
     char* getReceiveBinString();
     char* getLastReceiveBinString();
+    static void handleTiming(unsigned int duration);
     #endif
   
     void enableTransmit(int nTransmitterPin);
@@ -105,6 +198,21 @@ class RCSwitch {
     void setRepeatTransmit(int nRepeatTransmit);
     #if not defined( RCSwitchDisableReceiving )
     void setReceiveTolerance(int nPercent);
+    void setSeparationLimit(unsigned int nMicroseconds);
+    void setRepeatGapTolerance(unsigned int nMicroseconds);
+    void enableReceiveWhileTransmitting(unsigned int nEchoWindow = 200, unsigned int nHoldoffMillis = 500);
+    void disableReceiveWhileTransmitting();
+    unsigned long getEchoEdgeCount();
+    unsigned int getEchoFrameCount();
+    void enableNoiseGating(unsigned int nMinPulse = 80, int nPlausiblePercent = 75);
+    void disableNoiseGating();
+    unsigned long getGatedEdgeCount();
+    unsigned long getProcessedEdgeCount();
+    unsigned long getEdgeRate();
+    #if RCSWITCH_SOFT_COMBINING
+    void enableSoftCombining(int nFrames = 3);
+    void disableSoftCombining();
+    #endif
     #endif
 
     /**
@@ -118,6 +226,22 @@ class RCSwitch {
         uint8_t low;
     };
 
+    /**
+     * Line codes, i.e. how the data bits of a protocol map onto its HighLow
+     * factors. Sync signals are always sent and matched as plain HighLow.
+     */
+    enum LineCode {
+        /** a bit is the "zero" or "one" high/low pair, both durations count */
+        PULSE_WIDTH = 0,
+        /** like PULSE_WIDTH, but only the low gap after each pulse carries the bit */
+        PULSE_POSITION = 1,
+        /**
+         * a bit is two half bits of opposite level lasting zero.high and
+         * zero.low pulses: "0" is high then low, "1" is low then high
+         */
+        MANCHESTER = 2
+    };
+
     /**
      * A "protocol" describes how zero and one bits are encoded into high/low
      * pulses.
@@ -152,28 +276,245 @@ class RCSwitch {
          * some protocol have addition header or syn impuls beforre data. Next item is number impuls to shift start data block.
          */
         uint8_t shift;
+        /** one of LineCode, PULSE_WIDTH if left out of an initializer */
+        uint8_t lineCode;
     };
 
     void setProtocol(Protocol protocol);
-    void setProtocol(int nProtocol);
-    void setProtocol(int nProtocol, int nPulseLength);
+    bool setProtocol(int nProtocol);
+    bool setProtocol(int nProtocol, int nPulseLength);
+
+    int addProtocol(const Protocol* protocol);
+    bool removeProtocol(int nProtocol);
+    bool moveProtocol(int nProtocol, int nPosition);
+    int getProtocolCount();
+    int getProtocolNumber(int nPosition);
+    #if not defined( RCSwitchDisableReceiving )
+    unsigned int getProtocolHits(int nProtocol);
+    void sortProtocolsByHits();
+    void setProtocolAutoOrder(bool bEnable);
+
+    #if RCSWITCH_LEARNING
+    void enableLearning(bool bRegister = false, int nRepeats = 3);
+    void disableLearning();
+    bool learnedProtocolAvailable();
+    Protocol getLearnedProtocol();
+    int getLearnedProtocolNumber();
+    #endif
+
+    #if RCSWITCH_MAX_HYPOTHESES > 0
+    void enableInterleavedFrames();
+    void disableInterleavedFrames();
+    #endif
+    #endif
+
+    /**
+     * An entry of a device directory, which maps received codes to devices.
+     * A directory is an array of a power of two slots, filled by addDevice()
+     * or copied from its output into PROGMEM. Free slots are all zero.
+     */
+    struct Device {
+        unsigned long code;
+        uint8_t protocol;
+        /** 0 marks a free slot */
+        uint8_t bitlength;
+        /** application defined, e.g. an index into a table of devices */
+        uint16_t id;
+        /** application defined, e.g. on or off */
+        uint8_t action;
+    };
+
+    static unsigned int hashDevice(unsigned long code, unsigned int bitlength, unsigned int protocol);
+    static bool addDevice(Device* directory, unsigned int nSlots, const Device &device);
+    static bool findDevice(const Device* directory, unsigned int nSlots, unsigned long code,
+                           unsigned int bitlength, unsigned int protocol, Device &device);
+    static bool findDevice_P(const Device* directory, unsigned int nSlots, unsigned long code,
+                             unsigned int bitlength, unsigned int protocol, Device &device);
+
+    #if RCSWITCH_LATENCY_TRACING
+    /** Latencies aggregated per protocol, see getLatencyPercentile() */
+    enum Latency {
+        /** first edge of a received frame until available() reported it */
+        LATENCY_RECEIVE = 0,
+        /** end of a received frame until available() reported it */
+        LATENCY_DELIVERY = 1,
+        /** send() or enqueue() until the last repeat was sent */
+        LATENCY_TRANSMIT = 2,
+        /** enqueue() until the first repeat was sent, queued commands only */
+        LATENCY_QUEUE = 3
+    };
+
+    /** micros() timestamps of the last received frame */
+    struct ReceiveTrace {
+        unsigned long firstEdge;
+        /** the frame was decoded */
+        unsigned long complete;
+        /** available() reported the frame, 0 until then */
+        unsigned long delivered;
+    };
+
+    /** micros() timestamps of the last transmission */
+    struct TransmitTrace {
+        /** enqueue() or, for send(), the same as started */
+        unsigned long enqueued;
+        unsigned long started;
+        unsigned long finished;
+    };
+
+    #if not defined( RCSwitchDisableReceiving )
+    ReceiveTrace getReceivedTrace();
+    #endif
+    TransmitTrace getTransmitTrace();
+    static unsigned long getLatencyPercentile(int nProtocol, int nLatency, int nPercent);
+    static void resetLatencyStats();
+    #endif
 
   private:
+    #if RCSWITCH_LATENCY_TRACING
+    static const uint8_t nLatencies = 4;
+    /* bucket 0 counts latencies below 32 us, bucket n those below 32 << n us */
+    static const uint8_t nLatencyBuckets = 24;
+    #endif
+
+    /**
+     * An entry of the protocol registry. The registry order is the order
+     * in which the decoder tries the protocols.
+     */
+    struct ProtocolEntry {
+        /** the description, which lives in PROGMEM for the built-in ones */
+        const Protocol* protocol;
+        /** protocol number as used by setProtocol() and getReceivedProtocol() */
+        uint8_t number;
+        bool progmem;
+        #if not defined( RCSwitchDisableReceiving )
+        /** number of frames received with this protocol */
+        uint16_t hits;
+        /** specialized decoder, 0 to use the generic one */
+        bool (*decoder)(unsigned int changeCount);
+        #endif
+        #if RCSWITCH_LATENCY_TRACING
+        /** log2 histograms of the latencies, see recordLatency() */
+        uint8_t latency[nLatencies][nLatencyBuckets];
+        #endif
+    };
+
+    #if RCSWITCH_TX_QUEUE > 0
+    /** A command waiting in the transmit queue */
+    struct TransmitRequest {
+        Protocol protocol;
+        unsigned long code;
+        uint8_t length;
+        /** range the repeat count is adapted in to the airtime budget */
+        uint8_t minRepeats;
+        uint8_t maxRepeats;
+        #if RCSWITCH_LATENCY_TRACING
+        /** protocol number, 0 for one set by description */
+        uint8_t number;
+        unsigned long enqueued;
+        #endif
+    };
+    #endif
+
+    #if RCSWITCH_MAX_HYPOTHESES > 0
+    /**
+     * A transmitter tracked while interleaved frames are enabled. Frames
+     * belong to it if their sync timing and pulse length match, and they
+     * are confirmed against its previous frame only.
+     */
+    struct FrameHypothesis {
+        unsigned int syncDuration;
+        unsigned int pulseLength;
+        uint8_t protocol;
+        /** number of identical frames seen in a row, 0 if the slot is free */
+        uint8_t frames;
+        unsigned int bitlength;
+        /** hash of the bin string of the last frame */
+        unsigned long hash;
+        /** receive time of the last frame, see nReceiveTime */
+        unsigned long lastTime;
+    };
+    #endif
+
     char* getCodeWordA(const char* sGroup, const char* sDevice, bool bStatus);
     char* getCodeWordB(int nGroupNumber, int nSwitchNumber, bool bStatus);
     char* getCodeWordC(char sFamily, int nGroup, int nDevice, bool bStatus);
     char* getCodeWordD(char group, int nDevice, bool bStatus);
-    void transmit(HighLow pulses);
+    void transmitFrame(const char* sCodeWord);
+    void transmit(HighLow pulses, bool bLowFirst = false);
+    void transmitLevel(uint8_t level, unsigned int duration);
+    static unsigned long frameAirtime(const Protocol &pro, const char* sCodeWord);
+    #if RCSWITCH_TX_QUEUE > 0
+    void refillAirtime();
+    void chargeAirtime(unsigned long nMicroseconds);
+    #endif
+    static int findProtocol(int nProtocol);
+    #if RCSWITCH_LATENCY_TRACING
+    static void recordLatency(int nProtocol, int nLatency, unsigned long nMicros);
+    #endif
+    static void loadProtocol(const ProtocolEntry &entry, Protocol &pro);
+    static int registerProtocol(const Protocol* protocol);
+    static bool probeDevice(const Device* directory, unsigned int nSlots, unsigned long code,
+                            unsigned int bitlength, unsigned int protocol, Device &device, bool bProgmem);
 
     #if not defined( RCSwitchDisableReceiving )
     static void handleInterrupt();
-    static bool receiveProtocol(const int p, unsigned int changeCount);
+    static bool receiveProtocol(ProtocolEntry &entry, unsigned int changeCount);
+    static void decodeFrame(unsigned int changeCount);
+    #if RCSWITCH_MAX_HYPOTHESES > 0
+    static void decodeInterleaved(unsigned int changeCount, unsigned int gap);
+    static bool confirmFrame(const int p, unsigned int delayMicros, unsigned int bitlength);
+    #endif
+    template <int P> static bool receiveBuiltin(unsigned int changeCount);
+    static bool receiveProtocol(const Protocol &pro, const int p, unsigned int changeCount);
+    static int receiveManchester(const Protocol &pro, unsigned int firstDataTiming, unsigned int changeCount,
+                                 unsigned int delay, unsigned int delayTolerance, bool bLeadingHalf, unsigned long &code);
+    #if RCSWITCH_LEARNING
+    static bool inferProtocol(unsigned int changeCount, Protocol &pro);
+    static void learnFrame(unsigned int changeCount);
+    static int findLearnedSlot(const Protocol* protocol);
+    #endif
+    static bool isEcho(const char* sBinString);
+    static void publishFrame(unsigned long code, unsigned int bitlength, unsigned int delayMicros, int p, unsigned int confidence);
+    #if RCSWITCH_SOFT_COMBINING
+    static bool softCombine(const Protocol &pro, const int p, unsigned int firstDataTiming, unsigned int changeCount,
+                            unsigned int delay, unsigned int delayTolerance, unsigned int delayMicros);
+    #endif
+    static bool gateNoise(unsigned int duration);
     int nReceiverInterrupt;
+    bool bReceiveWhileTransmitting;
     #endif
     int nTransmitterPin;
     int nRepeatTransmit;
+    /* recording state of encodeWaveform(), pWaveform is 0 otherwise */
+    unsigned int* pWaveform;
+    int nWaveform;
+    int nWaveformMax;
+    int nWaveformLevel;
     
     Protocol protocol;
+    #if RCSWITCH_LATENCY_TRACING
+    /* number of the protocol, 0 if set by description */
+    uint8_t nTransmitProtocol;
+    /* set by transmitQueued(), whose command was enqueued at transmitTrace.enqueued */
+    bool bTraceQueued;
+    TransmitTrace transmitTrace;
+    #endif
+
+    #if RCSWITCH_TX_QUEUE > 0
+    TransmitRequest txQueue[RCSWITCH_TX_QUEUE];
+    uint8_t nTxQueueHead;
+    uint8_t nTxQueueCount;
+    /* duty cycle in per mille of nDutyWindow milliseconds, 0 for no limit */
+    unsigned int nDutyPermille;
+    unsigned long nDutyWindow;
+    /* microseconds of airtime left in the budget, negative if overdrawn */
+    long nAirtimeTokens;
+    /* millis() of the last refill of nAirtimeTokens */
+    unsigned long nAirtimeRefill;
+    /* airtime transmitted so far in milliseconds plus microseconds */
+    unsigned long nAirtimeMillis;
+    unsigned int nAirtimeMicros;
+    #endif
 
     #if not defined( RCSwitchDisableReceiving )
     static int nReceiveTolerance;
@@ -181,13 +522,95 @@ class RCSwitch {
     volatile static unsigned int nReceivedBitlength;
     volatile static unsigned int nReceivedDelay;
     volatile static unsigned int nReceivedProtocol;
-    const static unsigned int nSeparationLimit;
+    volatile static unsigned int nReceivedConfidence;
+    static unsigned int nSeparationLimit;
+    static unsigned int nRepeatGapTolerance;
     static char nReceiveBinString[RCSWITCH_MAX_CHANGES/2+1];
     static char nLastReceiveBinString[RCSWITCH_MAX_CHANGES/2+1];
     /* 
-     * timings[0] contains sync timing, followed by a number of bits
+     * timings[0] contains sync timing, followed by a number of bits,
+     * all in units of RCSWITCH_TIMING_TICK microseconds
+     */
+    static Timing timings[RCSWITCH_MAX_CHANGES];
+    /* full resolution copy of timings[0] in microseconds, which may saturate */
+    static unsigned int nSyncDuration;
+
+    #if RCSWITCH_LEARNING
+    /*
+     * Protocol learning: unknown frames with the same shape are collected
+     * in nLearnCandidate until nLearnRepeats of them agree.
+     */
+    static bool bLearning;
+    static bool bLearnRegister;
+    static uint8_t nLearnRepeats;
+    static uint8_t nLearnFrames;
+    static unsigned int nLearnChangeCount;
+    static unsigned long nLearnPulseSum;
+    static Protocol nLearnCandidate;
+    volatile static bool bLearnedAvailable;
+    static Protocol nLearnedProtocol;
+    volatile static uint8_t nLearnedNumber;
+    /* storage of the registered learned protocols, free if not in the registry */
+    static Protocol learnedProtocols[RCSWITCH_LEARNED_PROTOCOLS];
+    #endif
+
+    /*
+     * Interleaved frames: every frame is decoded on its own and confirmed
+     * by the hypothesis of its transmitter instead of nLastReceiveBinString.
      */
-    static unsigned int timings[RCSWITCH_MAX_CHANGES];
+    #if RCSWITCH_MAX_HYPOTHESES > 0
+    static bool bInterleavedFrames;
+    static FrameHypothesis hypotheses[RCSWITCH_MAX_HYPOTHESES];
+    #endif
+    /* microseconds received so far, wraps around */
+    static unsigned long nReceiveTime;
+
+    /*
+     * Self-echo rejection while receiving during transmissions: edges the
+     * receiver reports while our carrier is on or within nEchoWindow after
+     * our last level change are dropped, frames repeating our last code
+     * within nEchoHoldoff after it are not reported.
+     */
+    volatile static bool bEchoMasking;
+    static unsigned int nEchoWindow;
+    static unsigned long nEchoHoldoff;
+    volatile static uint8_t nTransmitLevel;
+    volatile static unsigned long nTransmitEdgeTime;
+    volatile static unsigned long nTransmitHash;
+    volatile static unsigned long nEchoEdges;
+    volatile static unsigned int nEchoFrames;
+
+    /*
+     * Noise gating: while too few edges of a block look like pulses of a
+     * frame, the interrupt handler only waits for a sync-like gap.
+     */
+    static bool bNoiseGating;
+    static unsigned int nMinPulse;
+    static uint8_t nPlausiblePercent;
+    volatile static bool bGated;
+    volatile static unsigned long nGatedEdges;
+    volatile static unsigned long nProcessedEdges;
+    /* microseconds the last block of edges took */
+    volatile static unsigned long nGateBlockTime;
+
+    #if RCSWITCH_SOFT_COMBINING
+    /*
+     * Soft combining: per-bit evidence for "1" (positive) or "0" (negative)
+     * summed over the frames of a burst, nSoftFrames of them are voted on.
+     */
+    static uint8_t nSoftFrames;
+    static uint8_t nSoftCount;
+    static uint8_t nSoftProtocol;
+    static uint8_t nSoftBits;
+    static unsigned long nSoftTime;
+    static int16_t softEvidence[sizeof(unsigned long) * 8];
+    #endif
+    #endif
+
+    static ProtocolEntry protocols[RCSWITCH_MAX_PROTOCOLS];
+    volatile static uint8_t nProtocols;
+    #if not defined( RCSwitchDisableReceiving )
+    static bool bProtocolAutoOrder;
     #endif
 
     
@@ -0,0 +1,75 @@
+/*
+  Example for mapping received codes to devices with a device directory
+
+  The directory is built from a plain list of devices at startup and
+  printed as a PROGMEM initializer. Paste that into the sketch and look it
+  up with findDevice_P() to keep thousands of devices in flash instead.
+
+  https://github.com/sui77/rc-switch/
+*/
+
+#include <RCSwitch.h>
+
+RCSwitch mySwitch = RCSwitch();
+
+enum { ACTION_OFF, ACTION_ON, ACTION_TRIGGER };
+
+// code, protocol, bitlength, device id, action
+const RCSwitch::Device knownDevices[] = {
+  { 5393, 1, 24, 1, ACTION_ON },
+  { 5396, 1, 24, 1, ACTION_OFF },
+  { 4433, 1, 24, 2, ACTION_ON },
+  { 4436, 1, 24, 2, ACTION_OFF },
+  { 1361, 1, 24, 3, ACTION_ON },
+  { 1364, 1, 24, 3, ACTION_OFF },
+  { 0x2E1C9A, 6, 24, 4, ACTION_TRIGGER },
+};
+const unsigned int nKnownDevices = sizeof(knownDevices) / sizeof(knownDevices[0]);
+
+// a power of two, about twice the number of devices
+const unsigned int nSlots = 16;
+RCSwitch::Device directory[nSlots];
+
+void setup() {
+  Serial.begin(9600);
+  mySwitch.enableReceive(0);  // Receiver on interrupt 0 => that is pin #2
+
+  for (unsigned int i = 0; i < nKnownDevices; i++) {
+    if (!RCSwitch::addDevice(directory, nSlots, knownDevices[i])) {
+      Serial.println("Directory full");
+    }
+  }
+
+  Serial.println("const RCSwitch::Device directory[] PROGMEM = {");
+  for (unsigned int i = 0; i < nSlots; i++) {
+    Serial.print("  { ");
+    Serial.print(directory[i].code);
+    Serial.print("UL, ");
+    Serial.print(directory[i].protocol);
+    Serial.print(", ");
+    Serial.print(directory[i].bitlength);
+    Serial.print(", ");
+    Serial.print(directory[i].id);
+    Serial.print(", ");
+    Serial.print(directory[i].action);
+    Serial.println(" },");
+  }
+  Serial.println("};");
+}
+
+void loop() {
+  if (mySwitch.available()) {
+    RCSwitch::Device device;
+    if (RCSwitch::findDevice(directory, nSlots, mySwitch.getReceivedValue(),
+                             mySwitch.getReceivedBitlength(), mySwitch.getReceivedProtocol(), device)) {
+      Serial.print("Device ");
+      Serial.print(device.id);
+      Serial.print(" action ");
+      Serial.println(device.action);
+    } else {
+      Serial.print("Unknown code ");
+      Serial.println(mySwitch.getReceivedValue());
+    }
+    mySwitch.resetAvailable();
+  }
+}
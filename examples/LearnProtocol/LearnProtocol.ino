@@ -0,0 +1,63 @@
+/*
+  Example for learning the protocol of an unknown remote
+
+  Press a button of the remote a few times. Once the frames of the remote
+  agree, the inferred protocol is printed in the format of the protocol
+  table in RCSwitch.cpp and added to the protocol registry, so it is used
+  for decoding from then on.
+
+  The library has to be compiled with RCSWITCH_LEARNING defined as 1, e.g.
+  with -DRCSWITCH_LEARNING=1 in the build flags.
+  
+  https://github.com/sui77/rc-switch/
+*/
+
+#include <RCSwitch.h>
+
+#if !RCSWITCH_LEARNING
+#error "LearnProtocol needs the library compiled with RCSWITCH_LEARNING defined as 1"
+#endif
+
+RCSwitch mySwitch = RCSwitch();
+
+void setup() {
+  Serial.begin(9600);
+  mySwitch.enableReceive(0);  // Receiver on interrupt 0 => that is pin #2
+  mySwitch.enableLearning(true);
+}
+
+void loop() {
+  if (mySwitch.learnedProtocolAvailable()) {
+    RCSwitch::Protocol p = mySwitch.getLearnedProtocol();
+    mySwitch.disableLearning();
+
+    Serial.print("Learned protocol: { ");
+    Serial.print(p.pulseLength);
+    printHighLow(p.startSyncFactor);
+    printHighLow(p.zero);
+    printHighLow(p.one);
+    printHighLow(p.stopSyncFactor);
+    Serial.println(p.invertedSignal ? ", true }" : ", false }");
+    Serial.print("Registered as protocol ");
+    Serial.println(mySwitch.getLearnedProtocolNumber());
+  }
+
+  if (mySwitch.available()) {
+    Serial.print("Received ");
+    Serial.print( mySwitch.getReceivedValue() );
+    Serial.print(" / ");
+    Serial.print( mySwitch.getReceivedBitlength() );
+    Serial.print("bit ");
+    Serial.print("Protocol: ");
+    Serial.println( mySwitch.getReceivedProtocol() );
+    mySwitch.resetAvailable();
+  }
+}
+
+void printHighLow(RCSwitch::HighLow h) {
+  Serial.print(", { ");
+  Serial.print(h.high);
+  Serial.print(", ");
+  Serial.print(h.low);
+  Serial.print(" }");
+}
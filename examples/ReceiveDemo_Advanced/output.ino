@@ -1,7 +1,7 @@
 static const char* bin2tristate(const char* bin);
 static char * dec2binWzerofill(unsigned long Dec, unsigned int bitLength);
 
-void output(unsigned long decimal, unsigned int length, unsigned int delay, unsigned int* raw, unsigned int protocol) {
+void output(unsigned long decimal, unsigned int length, unsigned int delay, RCSwitch::Timing* raw, unsigned int protocol) {
 
   if (decimal == 0) {
     Serial.print("Unknown encoding.");
@@ -22,9 +22,10 @@ void output(unsigned long decimal, unsigned int length, unsigned int delay, unsi
     Serial.println(protocol);
   }
   
+  // raw data is captured in ticks of RCSWITCH_TIMING_TICK microseconds
   Serial.print("Raw data: ");
   for (unsigned int i=0; i<= length*2; i++) {
-    Serial.print(raw[i]);
+    Serial.print((unsigned long)raw[i] * RCSWITCH_TIMING_TICK);
     Serial.print(",");
   }
   Serial.println();
@@ -0,0 +1,168 @@
+/*
+  Robustness sweep of the receive path
+
+  Synthesizes frames for every registered protocol with the library's own
+  encoder, impairs them and feeds them to the decoder through handleTiming().
+  No radio is needed. For each protocol, receiver setting, impairment and
+  impairment level one CSV line is printed:
+
+    protocol,tolerance,separation,gap tolerance,impairment,level,yield %,false %
+
+  The receiver settings are setReceiveTolerance(), setSeparationLimit() and
+  setRepeatGapTolerance(). Each is swept on its own while the others keep
+  their defaults (60%, 3500 us, 200 us).
+
+  yield is the share of bursts decoded to the sent code, false the share
+  decoded to another code. The "noise" lines feed random timings only, so
+  every decode there is a false positive. Protocols whose frames do not fit
+  the waveform buffer are reported with a comment line starting with "#".
+
+  Impairments, level 0..5:
+    jitter   each duration is off by up to level*10% of the pulse length
+    skew     the transmitter clock runs level*4% slow
+    dropped  each pulse is lost with a probability of level*2%
+    extra    each level is split by a 20 us glitch with level*2% probability
+    burst    level*4 random timings precede each frame of a burst
+    noise    level*200 random timings without any frame
+
+  https://github.com/sui77/rc-switch/
+*/
+
+#include <RCSwitch.h>
+
+RCSwitch mySwitch = RCSwitch();
+
+const int nBursts = 20;       // bursts per CSV line
+const int nRepeats = 4;       // frames per burst, raise it on boards with more RAM
+const int nBits = 24;
+// receive tolerance in %, separation limit and repeat gap tolerance in us
+const unsigned int settings[][3] = {
+  { 60, 3500, 200 },
+  { 30, 3500, 200 }, { 45, 3500, 200 }, { 75, 3500, 200 },
+  { 60, 2000, 200 }, { 60, 5000, 200 },
+  { 60, 3500, 100 }, { 60, 3500, 400 },
+};
+const char* impairments[] = { "jitter", "skew", "dropped", "extra", "burst", "noise" };
+
+unsigned int waveform[nRepeats * (2 * nBits + 4)];
+unsigned int nSeparation;   // separation limit of the current setting
+
+void setup() {
+  Serial.begin(9600);
+  Serial.println("protocol,tolerance,separation,gap tolerance,impairment,level,yield %,false %");
+
+  for (int nPosition = 0; nPosition < mySwitch.getProtocolCount(); nPosition++) {
+    const int nProtocol = mySwitch.getProtocolNumber(nPosition);
+    mySwitch.setProtocol(nProtocol);
+    bool bFits = true;
+    for (unsigned int s = 0; s < sizeof(settings) / sizeof(settings[0]) && bFits; s++) {
+      mySwitch.setReceiveTolerance(settings[s][0]);
+      mySwitch.setSeparationLimit(settings[s][1]);
+      mySwitch.setRepeatGapTolerance(settings[s][2]);
+      nSeparation = settings[s][1];
+      for (int impairment = 0; impairment < 6 && bFits; impairment++) {
+        for (int level = 0; level <= 5 && bFits; level++) {
+          bFits = sweep(nProtocol, settings[s], impairment, level);
+        }
+      }
+    }
+    if (!bFits) {
+      Serial.print("# protocol ");
+      Serial.print(nProtocol);
+      Serial.println(": frames do not fit the waveform buffer");
+    }
+  }
+  mySwitch.setReceiveTolerance(60);
+  mySwitch.setSeparationLimit(3500);
+  mySwitch.setRepeatGapTolerance(200);
+}
+
+void loop() {
+}
+
+/* returns false if the frames of the protocol do not fit the waveform buffer */
+bool sweep(int nProtocol, const unsigned int* setting, int impairment, int level) {
+  int nGood = 0;
+  int nFalse = 0;
+  for (int n = 0; n < nBursts; n++) {
+    const unsigned long code = random(1, 1L << nBits);
+    mySwitch.resetAvailable();
+
+    if (impairment == 5) {
+      for (int i = 0; i < level * 200; i++) {
+        RCSwitch::handleTiming(random(50, 6000));
+      }
+    } else {
+      char sCodeWord[nBits + 1];
+      for (int i = 0; i < nBits; i++) {
+        sCodeWord[i] = (code & (1L << (nBits - 1 - i))) ? '1' : '0';
+      }
+      sCodeWord[nBits] = '\0';
+      const int nDurations = mySwitch.encodeWaveform(sCodeWord, waveform, sizeof(waveform) / sizeof(waveform[0]), nRepeats);
+      if (nDurations < 1) {
+        return false;
+      }
+      // shortest duration of the waveform, close to the pulse length
+      unsigned int nPulse = waveform[0];
+      for (int i = 1; i < nDurations; i++) {
+        if (waveform[i] < nPulse) nPulse = waveform[i];
+      }
+      // the gap in front of the first frame is the stop sync of a previous one
+      feed(&waveform[nDurations - 1], 1, nPulse, impairment, level);
+      feed(waveform, nDurations, nPulse, impairment, level);
+    }
+
+    if (mySwitch.getReceivedValue() == code) {
+      nGood++;
+    } else if (mySwitch.getReceivedValue() != 0) {
+      nFalse++;
+    }
+  }
+
+  Serial.print(nProtocol);
+  Serial.print(",");
+  for (int i = 0; i < 3; i++) {
+    Serial.print(setting[i]);
+    Serial.print(",");
+  }
+  Serial.print(impairments[impairment]);
+  Serial.print(",");
+  Serial.print(level);
+  Serial.print(",");
+  Serial.print(100 * nGood / nBursts);
+  Serial.print(",");
+  Serial.println(100 * nFalse / nBursts);
+  return true;
+}
+
+/* jitter is scaled by nPulse, the pulse length of the whole waveform */
+void feed(const unsigned int* durations, int nDurations, unsigned int nPulse, int impairment, int level) {
+  unsigned long carry = 0;  // durations merged by a dropped pulse
+  for (int i = 0; i < nDurations; i++) {
+    long duration = durations[i];
+    if (impairment == 0) {
+      duration += random(-(long)nPulse * level / 10, (long)nPulse * level / 10 + 1);
+    } else if (impairment == 1) {
+      duration = duration * (100 + 4 * level) / 100;
+    } else if (impairment == 2 && i + 2 < nDurations && random(100) < 2 * level) {
+      // the receiver misses a pulse: this level, the pulse and the next level merge
+      carry += duration + durations[i + 1];
+      i++;
+      continue;
+    } else if (impairment == 3 && random(100) < 2 * level && duration > 40) {
+      const long part = random(1, duration - 20);
+      RCSwitch::handleTiming(carry + part);
+      RCSwitch::handleTiming(20);
+      carry = 0;
+      duration -= part + 20;
+    } else if (impairment == 4 && i > 0 && durations[i - 1] > nSeparation) {
+      // a new frame starts, precede it with a noise burst
+      for (int n = 0; n < level * 4; n++) {
+        RCSwitch::handleTiming(random(50, 3000));
+      }
+    }
+    if (duration < 1) duration = 1;
+    RCSwitch::handleTiming(carry + duration);
+    carry = 0;
+  }
+}
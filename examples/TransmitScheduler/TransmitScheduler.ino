@@ -0,0 +1,56 @@
+/*
+  Example for sending many commands within a duty-cycle limit
+
+  Commands are queued and sent from loop() as the airtime budget allows,
+  with fewer repeats while several commands are waiting.
+
+  The library has to be compiled with RCSWITCH_TX_QUEUE defined as the
+  queue length, e.g. with -DRCSWITCH_TX_QUEUE=4 in the build flags.
+
+  https://github.com/sui77/rc-switch/
+*/
+
+#include <RCSwitch.h>
+
+#if RCSWITCH_TX_QUEUE == 0
+#error "TransmitScheduler needs the library compiled with RCSWITCH_TX_QUEUE defined as the queue length"
+#endif
+
+RCSwitch mySwitch = RCSwitch();
+
+unsigned long lastReport = 0;
+
+void setup() {
+  Serial.begin(9600);
+
+  // Transmitter is connected to Arduino Pin #10
+  mySwitch.enableTransmit(10);
+
+  // Use at most 10% of the airtime of any 10 minutes
+  mySwitch.setDutyCycle(100, 600000UL);
+}
+
+void loop() {
+  if (Serial.available()) {
+    // every line received turns on a group of outlets
+    while (Serial.available()) Serial.read();
+    for (unsigned long code = 5393; code < 5393 + 4; code++) {
+      // outlets need 3 repeats at least, up to 10 when there is budget
+      if (!mySwitch.enqueue(code, 24, 3, 10)) {
+        Serial.println("Queue full");
+      }
+    }
+  }
+
+  mySwitch.transmitQueued();
+
+  if (millis() - lastReport > 5000) {
+    lastReport = millis();
+    Serial.print("Airtime: ");
+    Serial.print(mySwitch.getAirtimeTotal());
+    Serial.print(" ms, budget used: ");
+    Serial.print(mySwitch.getAirtimeUtilization());
+    Serial.print(" %, queued: ");
+    Serial.println(mySwitch.getQueueLength());
+  }
+}